@@ -1,3 +1,3 @@
 #!/bin/bash
 cd build/src/client
-./client $1
+./client $1 $2
@@ -0,0 +1,45 @@
+#include <string>
+#include <benchmark/benchmark.h>
+#include "../common/msg.h"
+
+//copy of the text to the body (client side)
+static void BM_msg_set(benchmark::State& state)
+{
+    std::string text(state.range(0), 'x');
+    msg m;
+    for (auto _ : state)
+    {
+        m.set(text);
+        benchmark::DoNotOptimize(m.body.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+//copy of the body to a string
+static void BM_msg_get(benchmark::State& state)
+{
+    msg m;
+    m.set(std::string(state.range(0), 'x'));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(m.get());
+
+    state.SetBytesProcessed(state.iterations() * m.body.size());
+}
+
+//view of a received slice, what the server uses instead of get
+static void BM_msg_buffer_view(benchmark::State& state)
+{
+    const std::size_t size = state.range(0);
+    auto buffer = std::make_shared<uint8_t[]>(size + 1);
+    std::memset(buffer.get(), 'x', size);
+    msg_buffer m(buffer, 0, size + 1);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(m.view());
+
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+BENCHMARK(BM_msg_set)->RangeMultiplier(8)->Range(16, 1 << 16);
+BENCHMARK(BM_msg_get)->RangeMultiplier(8)->Range(16, 1 << 16);
+BENCHMARK(BM_msg_buffer_view)->RangeMultiplier(8)->Range(16, 1 << 16);
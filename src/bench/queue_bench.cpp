@@ -0,0 +1,75 @@
+#include <thread>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "../common/ts_queue.h"
+#include "../common/mpsc_queue.h"
+#include "../common/msg.h"
+
+//messages pushed by all the producers in each iteration
+static constexpr std::size_t messages = 1 << 16;
+
+//the consumer loop of each queue, same as Server::run
+static std::size_t consume(ts_queue<msg_owner>& queue, std::size_t count)
+{
+    std::size_t popped = 0;
+    while (popped < count)
+    {
+        queue.wait();
+        while (!queue.empty())
+        {
+            benchmark::DoNotOptimize(queue.pop_front());
+            ++popped;
+        }
+    }
+    return popped;
+}
+
+static std::size_t consume(mpsc_queue<msg_owner>& queue, std::size_t count)
+{
+    std::size_t popped = 0;
+    msg_owner m;
+    while (popped < count)
+    {
+        queue.wait();
+        while (queue.try_pop(m))
+        {
+            benchmark::DoNotOptimize(m);
+            ++popped;
+        }
+    }
+    return popped;
+}
+
+//N producers (the connections) push to a single consumer (the dispatcher)
+template<typename Queue>
+static void BM_ingest_queue(benchmark::State& state)
+{
+    const std::size_t producers = state.range(0);
+    const std::size_t perProducer = messages / producers;
+
+    //same shape as the messages of the ingest path, a slice of a shared buffer
+    auto buffer = std::make_shared<uint8_t[]>(64);
+
+    for (auto _ : state)
+    {
+        Queue queue;
+        std::vector<std::thread> threads;
+        threads.reserve(producers);
+        for (std::size_t p = 0; p < producers; ++p)
+            threads.emplace_back([&]()
+                {
+                    for (std::size_t i = 0; i < perProducer; ++i)
+                        queue.push_back(msg_owner{ nullptr, msg_buffer(buffer, 0, 64), {} });
+                });
+
+        consume(queue, perProducer * producers);
+
+        for (auto& t : threads)
+            t.join();
+    }
+
+    state.SetItemsProcessed(state.iterations() * perProducer * producers);
+}
+
+BENCHMARK_TEMPLATE(BM_ingest_queue, ts_queue<msg_owner>)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_ingest_queue, mpsc_queue<msg_owner>)->RangeMultiplier(2)->Range(1, 64)->UseRealTime()->Unit(benchmark::kMillisecond);
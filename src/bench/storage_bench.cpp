@@ -0,0 +1,107 @@
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <memory>
+#include <filesystem>
+#include <benchmark/benchmark.h>
+#include "../server/Storage.h"
+
+//directory of the segments, tmpfs by default so the numbers are about the
+//storage code path and not the disk, BROKER_BENCH_DIR changes it
+static std::string bench_dir()
+{
+    const char* dir = std::getenv("BROKER_BENCH_DIR");
+    return std::string(dir ? dir : "/dev/shm") + "/broker_microbench";
+}
+
+//the path of the messages after the dispatcher: each writer appends the
+//batch to the segments of the clients and commits it
+//args: message size, messages per batch, clients
+static void storage_path(benchmark::State& state, durability mode, storage_layout layout = storage_layout::per_client)
+{
+    const std::size_t size = state.range(0);
+    const std::size_t batch = state.range(1);
+    const std::size_t clients = state.range(2);
+
+    storage_config config;
+    config.outputDir = bench_dir();
+    config.filePrefix = "bench";
+    config.fileSize = 16 * 1024 * 1024;
+    config.mode = mode;
+    config.layout = layout;
+
+    std::vector<std::string> ids;
+    for (std::size_t i = 0; i < clients; ++i)
+        ids.push_back("client" + std::to_string(i));
+    std::string message(size, 'x');
+
+    std::filesystem::remove_all(config.outputDir);
+    {
+        Storage storage(config);
+        for (auto _ : state)
+        {
+            for (std::size_t i = 0; i < batch; ++i)
+                storage.write(ids[i % clients], message);
+            storage.commit();
+        }
+    }
+    std::filesystem::remove_all(config.outputDir);
+
+    state.SetItemsProcessed(state.iterations() * batch);
+    state.SetBytesProcessed(state.iterations() * batch * (size + 1));
+}
+
+static void BM_storage_none(benchmark::State& state)
+{
+    storage_path(state, durability::none);
+}
+
+static void BM_storage_batch_sync(benchmark::State& state)
+{
+    storage_path(state, durability::batch);
+}
+
+static void BM_storage_shared_batch_sync(benchmark::State& state)
+{
+    storage_path(state, durability::batch, storage_layout::shared);
+}
+
+//every iteration fills a segment and rotates to the next one
+//args: preallocated segments (0 creates them on rotation), durability
+static void BM_storage_rotation(benchmark::State& state)
+{
+    storage_config config;
+    config.outputDir = bench_dir();
+    config.filePrefix = "bench";
+    config.fileSize = 1024 * 1024;
+    config.mode = static_cast<durability>(state.range(1));
+    config.preallocate = state.range(0) > 0;
+    config.spareSegments = state.range(0);
+
+    //the last message doesn't fit, it goes to the next segment
+    std::string message(4095, 'x');
+    const std::size_t batch = config.fileSize / 4096;
+
+    std::filesystem::remove_all(config.outputDir);
+    {
+        std::unique_ptr<SegmentAllocator> allocator;
+        if (config.preallocate)
+            allocator = std::make_unique<SegmentAllocator>(config.outputDir, config.fileSize, config.spareSegments);
+        Storage storage(config, nullptr, allocator.get());
+        for (auto _ : state)
+        {
+            for (std::size_t i = 0; i < batch; ++i)
+                storage.write("client", message);
+            storage.commit();
+        }
+    }
+    std::filesystem::remove_all(config.outputDir);
+
+    state.SetItemsProcessed(state.iterations() * batch);
+    state.SetBytesProcessed(state.iterations() * batch * 4096);
+}
+
+BENCHMARK(BM_storage_none)->ArgsProduct({ { 64, 1024 }, { 1, 64, 1024 }, { 1, 64 } })->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_storage_batch_sync)->ArgsProduct({ { 64, 1024 }, { 1, 64, 1024 }, { 1, 64 } })->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_storage_shared_batch_sync)->ArgsProduct({ { 64, 1024 }, { 1, 64, 1024 }, { 1, 64 } })->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_storage_rotation)->ArgsProduct({ { 0, 4 }, { static_cast<int>(durability::none), static_cast<int>(durability::batch) } })->Unit(benchmark::kMicrosecond);
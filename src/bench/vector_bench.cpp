@@ -0,0 +1,39 @@
+#include <memory>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <boost/asio.hpp>
+#include "../common/ts_vector.h"
+#include "../common/connection.h"
+
+//the old connection sweep: the whole vector of connections is scanned
+//under the lock and the dead ones are removed
+//about 1% of the connections are removed by each sweep
+static void BM_ts_vector_remove_if(benchmark::State& state)
+{
+    const std::size_t connections = state.range(0);
+
+    asio::io_context context;
+    mpsc_queue<msg_owner> queue(64);
+    std::vector<std::shared_ptr<connection>> all;
+    all.reserve(connections);
+    for (std::size_t i = 0; i < connections; ++i)
+        all.push_back(std::make_shared<connection>(connection::owner::server, context, asio::ip::tcp::socket(context), queue));
+
+    ts_vector<std::shared_ptr<connection>> vector;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        vector.clear();
+        for (const auto& c : all)
+            vector.push_back(c);
+        state.ResumeTiming();
+
+        //the uuids are random, so the first byte selects ~1% of them
+        vector.remove_if([](const std::shared_ptr<connection>& c) { return c->uuid().data[0] < 3; });
+        benchmark::DoNotOptimize(vector.size());
+    }
+
+    state.SetItemsProcessed(state.iterations() * connections);
+}
+
+BENCHMARK(BM_ts_vector_remove_if)->RangeMultiplier(4)->Range(1 << 10, 1 << 16)->Unit(benchmark::kMicrosecond);
@@ -12,10 +12,10 @@ Client::~Client()
 
     if (m_Thread.joinable()) m_Thread.join();
 
-    m_Connection.release();
+    m_Connection.reset();
 }
 
-void Client::connect(const std::string& host, std::string port)
+void Client::connect(const std::string& host, std::string port, const std::string& identity)
 {
     try
     {
@@ -27,9 +27,18 @@ void Client::connect(const std::string& host, std::string port)
         //create a connection pointer and give it the
         //task to connect to the server before running
         //so it doesn't die
-        m_Connection = std::make_unique<connection>(connection::owner::client, m_Context, asio::ip::tcp::socket(m_Context), m_QueueMsgIn);
+        m_Connection = std::make_shared<connection>(connection::owner::client, m_Context, asio::ip::tcp::socket(m_Context), m_QueueMsgIn);
         m_Connection->connect_to_server_task(endpoints);
 
+        //the identity handshake must be the first frame
+        //it's written as soon as the connection is made
+        if (!identity.empty())
+        {
+            msg handshake;
+            handshake.set_identity(identity);
+            m_Connection->send_msg(handshake);
+        }
+
         //start the thread context
         m_Thread = std::thread([this]() { m_Context.run(); });
     }
@@ -12,7 +12,9 @@ class Client {
 public:
     ~Client();
 
-    void connect(const std::string& host, std::string port);
+    //with an identity the server keeps the client's messages in the
+    //same place across connections
+    void connect(const std::string& host, std::string port, const std::string& identity = "");
 
     bool is_connected() const;
 
@@ -20,9 +22,10 @@ public:
 
 private:
     asio::io_context m_Context;
-    std::unique_ptr<connection> m_Connection;
+    std::shared_ptr<connection> m_Connection;
 
     std::thread m_Thread;
 
-    ts_queue<msg_owner> m_QueueMsgIn;
+    //the client doesn't receive messages, so it's small
+    mpsc_queue<msg_owner> m_QueueMsgIn{ 64 };
 };
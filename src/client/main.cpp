@@ -5,9 +5,10 @@
 int main(int argc, char* argv[])
 {
 	std::string port = argc < 2 ? "8080" : argv[1];
+	std::string identity = argc < 3 ? "" : argv[2];
 	//creates the client and connect to the server
 	Client client;
-	client.connect("127.0.0.1", port);
+	client.connect("127.0.0.1", port, identity);
 
 	//create a message and string object so it can
 	//be used for message input from the console
@@ -20,7 +21,9 @@ int main(int argc, char* argv[])
 		if (client.is_connected())
 		{
 			std::cout << "Message: ";
-			std::cin >> s;
+			//stops at the end of the input
+			if (!(std::cin >> s))
+				break;
 			m.set(s);
 			client.send_msg(m);
 		}
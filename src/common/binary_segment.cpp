@@ -0,0 +1,122 @@
+#include <chrono>
+#include <cstring>
+#include "binary_segment.h"
+#include "crc32c.h"
+
+std::uint64_t binary_segment::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void binary_segment::append_header(std::string& out, std::uint64_t baseOffset)
+{
+    std::size_t position = out.size();
+    out.resize(position + sizeof(file_header));
+    write_header(reinterpret_cast<std::uint8_t*>(out.data() + position), baseOffset);
+}
+
+void binary_segment::write_header(std::uint8_t* out, std::uint64_t baseOffset)
+{
+    file_header header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.baseOffset = baseOffset;
+    std::memcpy(out, &header, sizeof(header));
+}
+
+void binary_segment::append_record(std::string& out, std::uint64_t offset, std::uint64_t timestamp, std::string_view message)
+{
+    std::size_t position = out.size();
+    out.resize(position + sizeof(record_header) + message.size());
+    write_record(reinterpret_cast<std::uint8_t*>(out.data() + position), offset, timestamp, message);
+}
+
+void binary_segment::write_record(std::uint8_t* out, std::uint64_t offset, std::uint64_t timestamp, std::string_view message)
+{
+    record_header header;
+    header.length = static_cast<std::uint32_t>(message.size());
+    header.offset = offset;
+    header.timestamp = timestamp;
+    header.crc = record_crc(header, message.data());
+
+    //the destination may not be aligned
+    std::memcpy(out, &header, sizeof(header));
+    std::memcpy(out + sizeof(header), message.data(), message.size());
+}
+
+std::uint32_t binary_segment::record_crc(const record_header& header, const void* message)
+{
+    //the crc field itself is skipped
+    std::uint32_t crc = crc32c(&header.length, sizeof(header.length));
+    crc = crc32c(&header.offset, sizeof(header.offset) + sizeof(header.timestamp), crc);
+    return crc32c(message, header.length, crc);
+}
+
+const char* binary_segment::to_string(scan_error error)
+{
+    switch (error)
+    {
+    case scan_error::none: return "ok";
+    case scan_error::header: return "not a binary segment";
+    case scan_error::torn: return "incomplete last record";
+    case scan_error::checksum: return "checksum mismatch";
+    case scan_error::offset: return "offset out of sequence";
+    }
+    return "unknown";
+}
+
+binary_segment::scan_result binary_segment::scan(const std::uint8_t* data, std::size_t size,
+    const std::function<void(const record_header&, std::string_view)>& visit)
+{
+    scan_result result;
+
+    file_header file;
+    if (size < sizeof(file) || std::memcmp(data, magic, sizeof(magic)) != 0)
+    {
+        result.error = scan_error::header;
+        return result;
+    }
+    std::memcpy(&file, data, sizeof(file));
+    result.baseOffset = result.nextOffset = file.baseOffset;
+
+    std::size_t position = sizeof(file);
+    result.valid = position;
+    while (size - position >= sizeof(record_header))
+    {
+        //the records aren't aligned, the header is copied
+        record_header header;
+        std::memcpy(&header, data + position, sizeof(header));
+        if (header.length == 0)
+            break;
+
+        const std::uint8_t* message = data + position + sizeof(header);
+        if (header.length > size - position - sizeof(header))
+        {
+            result.error = scan_error::torn;
+            break;
+        }
+        if (record_crc(header, message) != header.crc)
+        {
+            result.error = scan_error::checksum;
+            break;
+        }
+        if (header.offset != result.nextOffset)
+        {
+            result.error = scan_error::offset;
+            break;
+        }
+
+        if (visit)
+            visit(header, std::string_view(reinterpret_cast<const char*>(message), header.length));
+
+        ++result.records;
+        ++result.nextOffset;
+        position += sizeof(header) + header.length;
+        result.valid = position;
+    }
+
+    //a partial header at the end
+    if (result.error == scan_error::none && position < size && size - position < sizeof(record_header))
+        result.error = scan_error::torn;
+    return result;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+
+//layout of the binary segments
+//a file header followed by the records, each one a record header and the message
+//the messages may contain anything (new lines included) since they are framed
+//by their length, and each record has it's own checksum
+//-------
+//the offsets are the position of the record in the client's stream: they start
+//at 0 and grow by one per record, across the segments of the client (the file
+//header has the offset of it's first record)
+//the integers are written in the native order (little endian)
+namespace binary_segment
+{
+    //extension of the binary segment files
+    constexpr std::string_view extension = ".seg";
+
+    constexpr char magic[8] = { 'B', 'R', 'K', 'S', 'E', 'G', '0', '1' };
+
+    struct file_header
+    {
+        char magic[8];
+        std::uint64_t baseOffset;
+    };
+
+    struct record_header
+    {
+        //message size, 0 is never written (an empty message isn't stored)
+        //so it marks the end of the records
+        std::uint32_t length;
+        //crc32c of length, offset, timestamp and the message
+        std::uint32_t crc;
+        std::uint64_t offset;
+        //nanoseconds since the unix epoch when the message was stored
+        std::uint64_t timestamp;
+    };
+
+    static_assert(sizeof(file_header) == 16);
+    static_assert(sizeof(record_header) == 24);
+
+    //nanoseconds since the unix epoch
+    std::uint64_t now();
+
+    //appends the file header of a segment starting at baseOffset
+    void append_header(std::string& out, std::uint64_t baseOffset);
+    //writes it to out (sizeof(file_header) bytes)
+    void write_header(std::uint8_t* out, std::uint64_t baseOffset);
+
+    //appends a record
+    void append_record(std::string& out, std::uint64_t offset, std::uint64_t timestamp, std::string_view message);
+    //writes it to out (sizeof(record_header) + message.size() bytes)
+    void write_record(std::uint8_t* out, std::uint64_t offset, std::uint64_t timestamp, std::string_view message);
+
+    //checksum of a record
+    std::uint32_t record_crc(const record_header& header, const void* message);
+
+    enum class scan_error
+    {
+        none,
+        //not a binary segment
+        header,
+        //the last record is incomplete (the file was cut while it was written)
+        torn,
+        //a record doesn't match it's checksum
+        checksum,
+        //a record doesn't have the next offset
+        offset
+    };
+
+    const char* to_string(scan_error error);
+
+    struct scan_result
+    {
+        scan_error error = scan_error::none;
+        std::uint64_t baseOffset = 0;
+        //offset of the next record to be written
+        std::uint64_t nextOffset = 0;
+        std::uint64_t records = 0;
+        //bytes of the header and the valid records, what comes after them
+        //(after an error) should be discarded
+        std::size_t valid = 0;
+    };
+
+    //checks the records of a segment in memory (usually mapped) until the end
+    //or the first invalid one, visit is called for every valid record
+    scan_result scan(const std::uint8_t* data, std::size_t size,
+        const std::function<void(const record_header&, std::string_view)>& visit = {});
+}
@@ -1,13 +1,31 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sys/socket.h>
 #include "connection.h"
 
-connection::connection(owner o, asio::io_context& context, asio::ip::tcp::socket&& socket, ts_queue<msg_owner>& msgIn, int timeout) :
-    m_Owner(o),
+//the generator is created and seeded (from the system entropy) once per thread
+//instead of once per connection, after that generating an id is only a few
+//mt19937 steps, without system calls or locks
+static boost::uuids::uuid next_uuid()
+{
+    thread_local boost::uuids::random_generator_mt19937 generator;
+    return generator();
+}
+
+connection::connection(owner o, asio::io_context& context, asio::ip::tcp::socket&& socket, mpsc_queue<msg_owner>& msgIn, timing_wheel* wheel,
+    std::size_t maxWriteBytes, const connection_metrics* metrics, uring* ring) :
     m_Context(context),
     m_Socket(std::move(socket)),
+    m_Wheel(wheel),
+    m_Metrics(metrics),
+    m_Owner(o),
+    m_Uuid(next_uuid()),
+    m_UuidString(boost::uuids::to_string(m_Uuid)),
+    m_StorageHash(std::hash<std::string>{}(m_UuidString)),
     m_QueueMsgIn(msgIn),
-    m_Timeout(timeout),
-    m_Timer(context, std::chrono::minutes(timeout)),
-    m_Uuid(boost::uuids::random_generator()())
+    m_MaxWriteBytes(maxWriteBytes),
+    m_Uring(ring)
 {
 }
 
@@ -16,6 +34,26 @@ const boost::uuids::uuid& connection::uuid() const
     return m_Uuid;
 }
 
+const std::string& connection::uuid_string() const
+{
+    return m_UuidString;
+}
+
+const std::string& connection::storage_id() const
+{
+    return m_Identity.empty() ? m_UuidString : m_Identity;
+}
+
+std::size_t connection::storage_hash() const
+{
+    return m_StorageHash;
+}
+
+bool connection::has_identity() const
+{
+    return !m_Identity.empty();
+}
+
 bool connection::is_connected() const
 {
     return m_Socket.is_open();
@@ -24,159 +62,515 @@ bool connection::is_connected() const
 void connection::disconnect()
 {
     if (m_Owner == owner::server)
-        std::cout << "[" << m_Uuid << "] disconnected\n";
+        log_info() << "[" << m_UuidString << "] disconnected";
     else
-        std::cout << "Disconnected\n";
+        log_info() << "Disconnected";
 
+    //closing the socket doesn't cancel the ring's receive
+    //but a shutdown ends it, and it closes the connection
     if (is_connected())
-        asio::post(m_Context, [this]() { m_Socket.close(); });
+        asio::post(m_Context, [this, self = this->shared_from_this()]()
+            {
+                if (m_Uring && m_Socket.is_open())
+                    ::shutdown(m_Socket.native_handle(), SHUT_RDWR);
+                else
+                    m_Socket.close();
+            });
 }
 
-void connection::disconnect_timer(const boost::system::error_code& error)
+void connection::registered(connection_registry* registry, connection_registry::slot s)
 {
-    //if the proccess was not aborted (the timer expired) we disconnect
-    //if not (the expiration time changed) we reset the timer
-    if (!error) {
-        disconnect();
-    }
-    else
-        m_Timer.async_wait(boost::bind(&connection::disconnect_timer, this, asio::placeholders::error));
+    m_Registry = registry;
+    m_Slot = s;
+}
+
+void connection::closed()
+{
+    //the peer may have closed it's side, so we close ours
+    boost::system::error_code error;
+    m_Socket.close(error);
+
+    if (m_Metrics)
+        m_Metrics->closed.inc();
+
+    //the read chain ends when the connection is closed, an empty
+    //message is pushed after the last one so the handler knows
+    //this connection will not send anything else
+    push_to_msg_queue(msg_buffer());
+
+    //leaves the registry, the pending handlers keep this
+    //object alive until they finish
+    if (m_Registry)
+        m_Registry->remove(m_Slot);
+}
+
+std::uint64_t connection::last_activity() const
+{
+    return m_LastActivity.load(std::memory_order_relaxed);
 }
 
 void connection::wait_to_client_msg_task()
 {
     if (is_connected())
     {
-        //starts the timer for client timeout
-        m_Timer.async_wait(boost::bind(&connection::disconnect_timer, this, asio::placeholders::error));
-        //give it task to wait for a new header
-        read_header_task();
+        //adds the connection to the wheel for client timeout
+        if (m_Wheel)
+        {
+            m_LastActivity.store(m_Wheel->now(), std::memory_order_relaxed);
+            m_Wheel->add(this->shared_from_this());
+        }
+        //give it task to wait for new messages
+        read_task();
     }
     else
-        std::cerr << "Failed connecting to the client: socket is disconnected\n";
+    {
+        log_error() << "Failed connecting to the client: socket is disconnected";
+        closed();
+    }
 }
 
-void connection::connect_to_server_task(const asio::ip::tcp::resolver::results_type& endpoints)
+void connection::connect_to_server_task(const asio::ip::tcp::resolver::results_type& endpoints,
+    std::function<void(bool)> onConnected)
 {
+    //the messages sent before the connection is made are only queued
+    //and written in order when it's made
+    m_Writing = true;
+
     asio::async_connect(m_Socket, endpoints,
-        [this](std::error_code ec, asio::ip::tcp::endpoint endpoint)
+        [this, self = this->shared_from_this(), onConnected = std::move(onConnected)](std::error_code ec, asio::ip::tcp::endpoint /*endpoint*/)
         {
             //if the connection was successful we wait for the server to
             //send a new header, but in this case only the client
             //sends information, so this is used "fake" a real scenario
             if (!ec)
-                read_header_task();
+            {
+                read_task();
+                write_task();
+            }
             else
-                std::cerr << "Failed connecting to the server: " << ec.message() << "\n";
+                log_error() << "Failed connecting to the server: " << ec.message();
+
+            if (onConnected)
+                onConnected(!ec);
         });
 }
 
 void connection::send_msg(const msg& m)
 {
-    asio::post(m_Context, [this, &m]()
+    //the message is copied since the caller may reuse it
+    //before the task runs
+    asio::post(m_Context, [this, self = this->shared_from_this(), m]() mutable
         {
-            //we check if it's empty because if it's not
-            //another message is already being processed
-            //and we don't want to dispatch a new task
-
-            //the new one will be automaticaly processed
-            //after the oldest ones
-            bool isEmpty = m_QueueMsgOut.empty();
-            m_QueueMsgOut.push_back(m);
-            if (isEmpty)
-                write_header_task();
+            //if a write is already in progress we don't dispatch a new task
+            //the new message will be written in the next flush
+            //together with all the others queued until then
+            m_QueueMsgOut.push_back(std::move(m));
+            if (!m_Writing)
+                write_task();
         });
 }
 
-void connection::read_header_task()
+void connection::on_written(std::function<void(std::size_t)> handler)
 {
-    asio::async_read(m_Socket, asio::buffer(&m_TempMsg.header, sizeof(msg_header)),
-        [this](std::error_code error, std::size_t size)
+    m_OnWritten = std::move(handler);
+}
+
+void connection::read_task()
+{
+    if (m_Uring)
+    {
+        if (m_UringPending++ == 0)
+            m_UringSelf = this->shared_from_this();
+        m_Uring->recv_multishot(this, op_recv, m_Socket.native_handle());
+        return;
+    }
+
+    prepare_recv_buffer();
+
+    //reads whatever is available, which can be several messages at once
+    //or only part of one
+    m_Socket.async_read_some(asio::buffer(m_RecvBuffer.get() + m_RecvEnd, m_RecvCapacity - m_RecvEnd),
+        [this, self = this->shared_from_this()](const boost::system::error_code& error, std::size_t size)
         {
-            //extends the timer expiration
-            m_Timer.expires_at(std::chrono::steady_clock::now() + std::chrono::minutes(m_Timeout));
+            //marks the activity so the wheel extends the timeout
+            if (m_Wheel)
+                m_LastActivity.store(m_Wheel->now(), std::memory_order_relaxed);
 
             if (!error)
             {
-                //if the message has any content we need to resize the body vector
-                //and dispatch the read body task
-                //if we ignore and await for a new message
-                if (m_TempMsg.header.size > 0)
-                {
-                    m_TempMsg.body.resize(m_TempMsg.header.size);
-                    read_body_task();
-                }
+                if (m_Metrics)
+                    m_Metrics->bytesIn.inc(size);
+
+                m_RecvEnd += size;
+                if (parse_recv_buffer(msg_trace::now()))
+                    read_task();
                 else
-                    read_header_task();
+                    closed();
             }
             else
-                std::cerr << "Failed to read the header: " << error.message() << "\n";
+            {
+                if (error != asio::error::eof && error != asio::error::operation_aborted)
+                    log_warn() << "Failed to read: " << error.message();
+                closed();
+            }
         }
     );
 }
 
-void connection::read_body_task()
+void connection::prepare_recv_buffer()
+{
+    //the buffer is only allocated at the first read so idle
+    //connections don't hold it before they are used
+    if (!m_RecvBuffer)
+    {
+        m_RecvBuffer = std::make_shared_for_overwrite<uint8_t[]>(recv_buffer_size);
+        m_RecvCapacity = recv_buffer_size;
+    }
+
+    //everything was parsed and no message references the buffer
+    //so the next read starts from the beginning
+    //the fence pairs with the release of the last reference made by
+    //other threads, so they are done reading it before we write
+    std::size_t pending = m_RecvEnd - m_RecvBegin;
+    if (pending == 0 && m_RecvBuffer.use_count() == 1)
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        m_RecvBegin = m_RecvEnd = 0;
+    }
+
+    //how many bytes the message at the beginning needs
+    //if the header is not complete we only know it needs the header
+    std::size_t needed = sizeof(msg_header);
+    if (pending >= sizeof(msg_header))
+    {
+        msg_header header;
+        std::memcpy(&header, m_RecvBuffer.get() + m_RecvBegin, sizeof(msg_header));
+        needed += header.body_size();
+    }
+
+    //there is room for the partial message and a useful read
+    if (m_RecvBegin + needed <= m_RecvCapacity && m_RecvCapacity - m_RecvEnd >= recv_min_read)
+        return;
+
+    //the partial message needs to go to the beginning of the buffer
+    //if no message references the buffer we can move it in place, if not
+    //we copy only the partial message to a new buffer and the old one is
+    //released with the last message that uses it
+    std::size_t capacity = std::max(needed, recv_buffer_size);
+    if (m_RecvBuffer.use_count() == 1 && capacity <= m_RecvCapacity)
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        std::memmove(m_RecvBuffer.get(), m_RecvBuffer.get() + m_RecvBegin, pending);
+    }
+    else
+    {
+        auto buffer = std::make_shared_for_overwrite<uint8_t[]>(capacity);
+        std::memcpy(buffer.get(), m_RecvBuffer.get() + m_RecvBegin, pending);
+        m_RecvBuffer = std::move(buffer);
+        m_RecvCapacity = capacity;
+    }
+
+    m_RecvBegin = 0;
+    m_RecvEnd = pending;
+}
+
+bool connection::parse_recv_buffer(std::uint64_t now)
 {
-    asio::async_read(m_Socket, asio::buffer(m_TempMsg.body.data(), m_TempMsg.body.size()), 
-        [this](std::error_code error, std::size_t size)
+    while (m_RecvEnd - m_RecvBegin >= sizeof(msg_header))
+    {
+        //the header is copied because the buffer position may not be aligned
+        msg_header header;
+        std::memcpy(&header, m_RecvBuffer.get() + m_RecvBegin, sizeof(msg_header));
+        std::size_t size = header.body_size();
+
+        //control frames are small, a big one is a broken client
+        if (header.is_control() && size > max_control_size)
         {
-            //if everything is ok the read message is added to the queue
-            if (!error)
-                push_to_msg_queue_task();
-            else
-                std::cerr << "Failed to read the body: " << error.message() << "\n";
+            log_warn() << "[" << m_UuidString << "] control frame too big";
+            return false;
         }
-    );
+
+        //the header of a message split between reads was complete
+        //at an earlier read
+        msg_trace trace;
+        trace.headerRead = m_RecvHeaderTime != 0 ? m_RecvHeaderTime : now;
+
+        //the body is not complete, wait for the next read
+        if (m_RecvEnd - m_RecvBegin < sizeof(msg_header) + size)
+        {
+            m_RecvHeaderTime = trace.headerRead;
+            break;
+        }
+        m_RecvHeaderTime = 0;
+        trace.bodyComplete = now;
+
+        msg_buffer body(m_RecvBuffer, m_RecvBegin + sizeof(msg_header), size);
+        m_RecvBegin += sizeof(msg_header) + size;
+
+        //messages without content are ignored
+        //the others are pushed as a slice of the buffer, without copying
+        if (header.is_control())
+        {
+            if (!on_control(body))
+                return false;
+        }
+        else if (size > 0)
+        {
+            if (m_Metrics)
+                m_Metrics->messagesIn.inc();
+            push_to_msg_queue(std::move(body), trace);
+        }
+    }
+
+    return true;
 }
 
-void connection::write_header_task()
+//8-4-4-4-12 hexadecimal digits, the form of uuid_string
+static bool uuid_shaped(std::string_view id)
 {
-    asio::async_write(m_Socket, asio::buffer(&m_QueueMsgOut.front().header, sizeof(msg_header)),
-        [this](std::error_code error, size_t size)
+    if (id.size() != 36)
+        return false;
+    for (std::size_t i = 0; i < id.size(); ++i)
+    {
+        bool dash = i == 8 || i == 13 || i == 18 || i == 23;
+        if (dash ? id[i] != '-' : !std::isxdigit(static_cast<unsigned char>(id[i])))
+            return false;
+    }
+    return true;
+}
+
+//the identity names the client's directory, so it's limited to
+//characters that are safe in a file name
+//the anonymous clients are stored under their uuid, an identity shaped like
+//one could append to the stream of another client
+static bool valid_identity(std::string_view id)
+{
+    if (id.empty() || id.size() > 128 || id == "." || id == ".." || uuid_shaped(id))
+        return false;
+    return std::all_of(id.begin(), id.end(), [](char c)
         {
-            if (!error)
-            {
-                //if the message first message body isn't empty we write it's body
-                //if not we remove it and check there is any other message in
-                //the queue, if yes we dispatch the write header task again for this message
-                if (!m_QueueMsgOut.front().body.empty())
-                    write_body_task();
-                else
-                {
-                    m_QueueMsgOut.pop_front();
-                    if (!m_QueueMsgOut.empty())
-                        write_header_task();
-                }
-            }
-            else
-                std::cerr << "Failed to write the header: " << error.message() << "\n";
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || c == '.';
+        });
+}
+
+bool connection::on_control(const msg_buffer& frame)
+{
+    if (frame.empty())
+        return false;
+
+    std::string_view payload(reinterpret_cast<const char*>(frame.data()) + 1, frame.size() - 1);
+    switch (static_cast<control_type>(frame.data()[0]))
+    {
+    case control_type::identity:
+        //the messages already pushed are stored with the uuid, so the
+        //identity can only be declared before them (and only once)
+        if (m_Pushed || !m_Identity.empty() || !valid_identity(payload))
+        {
+            log_warn() << "[" << m_UuidString << "] invalid identity handshake";
+            return false;
         }
-    );
+        m_Identity = payload;
+        m_StorageHash = std::hash<std::string>{}(m_Identity);
+        log_info() << "[" << m_UuidString << "] identified as " << m_Identity;
+        return true;
+    }
+
+    log_warn() << "[" << m_UuidString << "] unknown control frame";
+    return false;
 }
 
-void connection::write_body_task()
+void connection::write_task()
 {
-    asio::async_write(m_Socket, asio::buffer(m_QueueMsgOut.front().body.data(), m_QueueMsgOut.front().body.size()),
-        [this](std::error_code error, size_t size)
+    //moves the queued messages to the batch until the byte cap is reached
+    //the first message is always taken, even if it's bigger than the cap
+    std::size_t bytes = 0;
+    while (!m_QueueMsgOut.empty())
+    {
+        std::size_t size = sizeof(msg_header) + m_QueueMsgOut.front().body.size();
+        if (!m_WriteBatch.empty() && bytes + size > m_MaxWriteBytes)
+            break;
+
+        m_WriteBatch.push_back(m_QueueMsgOut.pop_front());
+        bytes += size;
+    }
+
+    //nothing left to write
+    if (m_WriteBatch.empty())
+    {
+        m_Writing = false;
+        return;
+    }
+
+    //one buffer for each header and body, so the batch is written
+    //with a single scatter-gather write
+    m_WriteBuffers.clear();
+    for (const msg& m : m_WriteBatch)
+    {
+        m_WriteBuffers.push_back(asio::buffer(&m.header, sizeof(msg_header)));
+        if (!m.body.empty())
+            m_WriteBuffers.push_back(asio::buffer(m.body));
+    }
+
+    m_Writing = true;
+    if (m_Uring)
+    {
+        m_UringIov.clear();
+        for (const asio::const_buffer& buffer : m_WriteBuffers)
+            m_UringIov.push_back({ const_cast<void*>(buffer.data()), buffer.size() });
+        m_UringMsg = {};
+        m_UringMsg.msg_iov = m_UringIov.data();
+        m_UringMsg.msg_iovlen = m_UringIov.size();
+        uring_send();
+        return;
+    }
+
+    asio::async_write(m_Socket, m_WriteBuffers,
+        [this, self = this->shared_from_this()](std::error_code error, size_t /*size*/)
         {
+            //if everything is ok we flush whatever was queued
+            //while this batch was being written
             if (!error)
+                write_completed();
+            else
             {
-                //since the full message (header + body) has been written
-                //we can pop it and check if there is any other message
-                //and if yes dispatch the write header task again
-                m_QueueMsgOut.pop_front();
-
-                if (!m_QueueMsgOut.empty())
-                    write_header_task();
+                m_WriteBatch.clear();
+                m_Writing = false;
+                log_warn() << "Failed to write: " << error.message();
             }
-            else
-                std::cerr << "Failed to write the body: " << error.message() << "\n";
         }
     );
 }
 
-void connection::push_to_msg_queue_task()
+void connection::write_completed()
+{
+    if (m_OnWritten)
+        m_OnWritten(m_WriteBatch.size());
+    m_WriteBatch.clear();
+    write_task();
+}
+
+void connection::on_uring(std::uint8_t op, int result, std::uint32_t flags)
 {
+    //the last operation released, the connection may be destroyed
+    //when this returns
+    std::shared_ptr<connection> self;
+    if (!(flags & IORING_CQE_F_MORE) && --m_UringPending == 0)
+        self = std::move(m_UringSelf);
+
+    if (op == op_recv)
+        uring_received(result, flags);
+    else
+        uring_sent(result);
+}
+
+void connection::on_uring_abandon()
+{
+    m_UringPending = 0;
+    m_UringSelf.reset();
+}
+
+void connection::uring_received(int result, std::uint32_t flags)
+{
+    if (result > 0)
+    {
+        //marks the activity so the wheel extends the timeout
+        if (m_Wheel)
+            m_LastActivity.store(m_Wheel->now(), std::memory_order_relaxed);
+        if (m_Metrics)
+            m_Metrics->bytesIn.inc(result);
+
+        std::uint16_t id = flags >> IORING_CQE_BUFFER_SHIFT;
+        bool ok = m_UringFailed || receive(m_Uring->buffer(id), result, msg_trace::now());
+        m_Uring->recycle(id);
+
+        //the client broke the protocol, the shutdown ends the receive
+        if (!ok)
+        {
+            m_UringFailed = true;
+            ::shutdown(m_Socket.native_handle(), SHUT_RDWR);
+        }
+    }
+    else if (flags & IORING_CQE_F_BUFFER)
+        m_Uring->recycle(flags >> IORING_CQE_BUFFER_SHIFT);
+
+    if (flags & IORING_CQE_F_MORE)
+        return;
+
+    //the receive stops if it runs out of buffers (or the kernel decides it)
+    //it's started again, otherwise the connection was closed
+    if ((result > 0 || result == -ENOBUFS) && !m_UringFailed && is_connected())
+    {
+        read_task();
+        return;
+    }
+
+    if (result < 0 && result != -ECONNRESET && result != -ENOBUFS)
+        log_warn() << "Failed to read: " << std::strerror(-result);
+    closed();
+}
+
+void connection::uring_send()
+{
+    if (m_UringPending++ == 0)
+        m_UringSelf = this->shared_from_this();
+    m_Uring->sendmsg(this, op_send, m_Socket.native_handle(), &m_UringMsg);
+}
+
+void connection::uring_sent(int result)
+{
+    if (result < 0)
+    {
+        m_WriteBatch.clear();
+        m_Writing = false;
+        log_warn() << "Failed to write: " << std::strerror(-result);
+        return;
+    }
+
+    //a short send, the rest is sent from where it stopped
+    std::size_t sent = result;
+    while (m_UringMsg.msg_iovlen > 0 && sent >= m_UringMsg.msg_iov->iov_len)
+    {
+        sent -= m_UringMsg.msg_iov->iov_len;
+        ++m_UringMsg.msg_iov;
+        --m_UringMsg.msg_iovlen;
+    }
+    if (m_UringMsg.msg_iovlen > 0)
+    {
+        m_UringMsg.msg_iov->iov_base = static_cast<char*>(m_UringMsg.msg_iov->iov_base) + sent;
+        m_UringMsg.msg_iov->iov_len -= sent;
+        uring_send();
+        return;
+    }
+
+    write_completed();
+}
+
+bool connection::receive(const std::uint8_t* data, std::size_t size, std::uint64_t now)
+{
+    //the data may be bigger than the free space of the receive buffer
+    //so it's copied in parts, parsing makes room for the next one
+    while (size > 0)
+    {
+        prepare_recv_buffer();
+        std::size_t part = std::min(size, m_RecvCapacity - m_RecvEnd);
+        std::memcpy(m_RecvBuffer.get() + m_RecvEnd, data, part);
+        m_RecvEnd += part;
+        data += part;
+        size -= part;
+
+        if (!parse_recv_buffer(now))
+            return false;
+    }
+    return true;
+}
+
+void connection::push_to_msg_queue(msg_buffer&& m, msg_trace trace)
+{
+    //taken before the push, so the time waiting for room
+    //in a full queue counts as queue time
+    trace.queuePush = msg_trace::now();
+    m_Pushed = true;
+
     //if the message owner (who recived it) is the server
     //we pass a shared pointer of this object so we can have access to the
     //connection info when reading the message
@@ -184,10 +578,7 @@ void connection::push_to_msg_queue_task()
     //in the client case the pointer isn't passed because we alredy know about
     //the connection, sice it can only be the server
     if (m_Owner == owner::server)
-        m_QueueMsgIn.push_back({ this->shared_from_this(), m_TempMsg });
+        m_QueueMsgIn.push_back({ this->shared_from_this(), std::move(m), trace });
     else
-        m_QueueMsgIn.push_back({ nullptr, m_TempMsg });
-
-    //dispatch a read header task for await new messages
-    read_header_task();
+        m_QueueMsgIn.push_back({ nullptr, std::move(m), trace });
 }
@@ -2,17 +2,33 @@
 #include <iostream>
 #include <memory>
 #include <chrono>
+#include <string>
+#include <atomic>
+#include <functional>
 #include <boost/asio.hpp>
-#include <boost/bind/bind.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include "msg.h"
 #include "ts_queue.h"
+#include "mpsc_queue.h"
+#include "timing_wheel.h"
+#include "connection_registry.h"
+#include "metrics.h"
+#include "logger.h"
+#include "uring.h"
 
 using namespace boost;
 
-class connection : public std::enable_shared_from_this<connection>
+//metrics updated by the connections, owned by whoever creates them
+struct connection_metrics
+{
+    metrics_counter& closed;
+    metrics_counter& messagesIn;
+    metrics_counter& bytesIn;
+};
+
+class connection : public std::enable_shared_from_this<connection>, private uring_handler
 {
 public:
     enum class owner
@@ -20,63 +36,175 @@ public:
         server, client
     };
 
-    connection(owner o, asio::io_context& context, asio::ip::tcp::socket&& socket, ts_queue<msg_owner>& msgIn, int timeout = 1);
+    connection(owner o, asio::io_context& context, asio::ip::tcp::socket&& socket, mpsc_queue<msg_owner>& msgIn, timing_wheel* wheel = nullptr,
+        std::size_t maxWriteBytes = 64 * 1024, const connection_metrics* metrics = nullptr, uring* ring = nullptr);
 
     //connection uuid
     const boost::uuids::uuid& uuid() const;
 
+    //connection uuid formatted as a string, it's cached
+    //so it can be used for every message
+    const std::string& uuid_string() const;
+
+    //name of the client's storage stream, the identity declared in the
+    //handshake or the uuid if the client didn't declare one
+    //the handshake is the first frame, so it doesn't change after the
+    //first message is pushed and the message handlers can read it
+    const std::string& storage_id() const;
+
+    //hash of the storage id, the storage is sharded by it
+    std::size_t storage_hash() const;
+
+    //did the client declare an identity
+    bool has_identity() const;
+
     //is the connection alive
     bool is_connected() const;
 
     //closes the connection if open
     void disconnect();
 
-    //function used as the callback for time out
-    void disconnect_timer(const boost::system::error_code& e);
+    //called by the registry when the connection is added to it
+    //the connection removes itself when it's closed
+    void registered(connection_registry* registry, connection_registry::slot s);
+
+    //tick of the timing wheel when the last message was received
+    std::uint64_t last_activity() const;
 
     //------------- TASKS ---------------
     //after the client connection we wait for a message
     void wait_to_client_msg_task();
 
     //connects the client to the server
-    void connect_to_server_task(const asio::ip::tcp::resolver::results_type& endpoints);
+    //the optional handler is called with the result when the connection is made (or fails)
+    void connect_to_server_task(const asio::ip::tcp::resolver::results_type& endpoints,
+        std::function<void(bool)> onConnected = {});
     //------------- TASKS ---------------
 
     //adds a new message to the out message queue
     //and dispatch a task to write it
     void send_msg(const msg& m);
 
+    //handler called after every write with the number of messages written
+    //it runs on the connection's context, should be set before the first message
+    void on_written(std::function<void(std::size_t)> handler);
+
 private:
     //------------- TASKS ---------------
-    //task responsible to await for a new message and read it's header
-    void read_header_task();
+    //task responsible to await for new data and read as much as the socket has
+    //every complete message (header + body) in the buffer is pushed to the queue
+    //and a partial one is kept for the next read
+    void read_task();
 
-    //task responsible to await for the body and read it after the header has been read
-    void read_body_task();
+    //task responsible for writing the queued messages
+    //all the pending messages (up to m_MaxWriteBytes) are gathered in a single write
+    void write_task();
 
-    //task responsible for writing the header of the sent message
-    void write_header_task();
+    //------------- TASKS ---------------
 
-    //task responsible for writing the body of the sent message after the header has been written
-    void write_body_task();
+    //the batch was written, the next one is started
+    void write_completed();
 
-    //task responsible for pushing the incoming message to the queue
-    void push_to_msg_queue_task();
-    //------------- TASKS ---------------
+    //------------- IO_URING ---------------
+    //with a ring the socket reads and writes are made by it instead of asio
+    //the receive is multishot, it completes for every read until the connection
+    //is closed, and the data comes in the ring's buffers, which are copied to the
+    //receive buffer and returned right away
+    enum : std::uint8_t
+    {
+        op_recv, op_send
+    };
+
+    void on_uring(std::uint8_t op, int result, std::uint32_t flags) override;
+    void on_uring_abandon() override;
+
+    void uring_received(int result, std::uint32_t flags);
+    void uring_sent(int result);
+
+    //sends the remaining iovecs of m_UringMsg
+    void uring_send();
+
+    //copies the received data to the receive buffer and parses it
+    //returns false if the client broke the protocol
+    bool receive(const std::uint8_t* data, std::size_t size, std::uint64_t now);
+    //------------- IO_URING ---------------
+
+    //called once when the read chain ends (the connection was closed)
+    void closed();
+
+    //makes sure there is room in the receive buffer for the next read
+    void prepare_recv_buffer();
+
+    //parses all the complete messages in the receive buffer
+    //now is the time the data was read
+    //returns false if the client broke the protocol
+    bool parse_recv_buffer(std::uint64_t now);
+
+    //handles a control frame, returns false if it's invalid
+    bool on_control(const msg_buffer& frame);
+
+    //pushes the incoming message to the queue
+    void push_to_msg_queue(msg_buffer&& m, msg_trace trace = {});
 
     //asio
     asio::io_context& m_Context;
     asio::ip::tcp::socket m_Socket;
-    boost::asio::steady_timer m_Timer;
-    int m_Timeout;
+
+    //idle timeout, the server connections are added to the wheel
+    //and only update their last activity when a message arrives
+    timing_wheel* m_Wheel;
+    std::atomic<std::uint64_t> m_LastActivity = 0;
+
+    //optional (only for the server)
+    const connection_metrics* m_Metrics;
 
     //infomation
     owner m_Owner;
     boost::uuids::uuid m_Uuid;
+    std::string m_UuidString;
+    std::string m_Identity;
+    std::size_t m_StorageHash;
+    //a message was pushed, the identity can't be declared anymore
+    bool m_Pushed = false;
+
+    //registry of the live connections (only for the server)
+    connection_registry* m_Registry = nullptr;
+    connection_registry::slot m_Slot;
+
+    //receive buffer
+    //[m_RecvBegin, m_RecvEnd) holds the data not parsed yet
+    //the parsed messages are slices of this buffer, so it's only reused
+    //in place when no message references it anymore
+    static constexpr std::size_t recv_buffer_size = 8 * 1024;
+    //below this free space we make room before reading again
+    static constexpr std::size_t recv_min_read = 512;
+    //biggest control frame accepted
+    static constexpr std::size_t max_control_size = 1024;
+    std::shared_ptr<uint8_t[]> m_RecvBuffer;
+    std::size_t m_RecvCapacity = 0;
+    std::size_t m_RecvBegin = 0;
+    std::size_t m_RecvEnd = 0;
+    //time the header of the partial message was complete (0 if it wasn't)
+    std::uint64_t m_RecvHeaderTime = 0;
 
     //messages
-    msg m_TempMsg;
-    ts_queue<msg_owner>& m_QueueMsgIn;
+    mpsc_queue<msg_owner>& m_QueueMsgIn;
     ts_queue<msg> m_QueueMsgOut;
 
+    //messages being written and the buffers pointing to them
+    std::vector<msg> m_WriteBatch;
+    std::vector<asio::const_buffer> m_WriteBuffers;
+    std::size_t m_MaxWriteBytes;
+    bool m_Writing = false;
+    std::function<void(std::size_t)> m_OnWritten;
+
+    //io_uring (only for the server)
+    //the connection keeps itself alive while it has operations in the ring
+    uring* m_Uring;
+    std::shared_ptr<connection> m_UringSelf;
+    std::size_t m_UringPending = 0;
+    std::vector<iovec> m_UringIov;
+    msghdr m_UringMsg{};
+    bool m_UringFailed = false;
+
 };
@@ -0,0 +1,90 @@
+#include "connection_registry.h"
+#include "connection.h"
+
+connection_registry::connection_registry(std::size_t shards)
+{
+    shards = std::max<std::size_t>(1, shards);
+    m_Shards.reserve(shards);
+    for (std::size_t i = 0; i < shards; ++i)
+        m_Shards.emplace_back(std::make_unique<shard>());
+}
+
+void connection_registry::add(const std::shared_ptr<connection>& c)
+{
+    //the shards are used in a round robin fashion
+    slot s;
+    s.shard = static_cast<std::uint32_t>(m_Next.fetch_add(1, std::memory_order_relaxed) % m_Shards.size());
+    shard& sh = *m_Shards[s.shard];
+
+    {
+        std::scoped_lock lock(sh.mutex);
+        //reuses an empty slot if there is one
+        if (!sh.free.empty())
+        {
+            s.index = sh.free.back();
+            sh.free.pop_back();
+            sh.slots[s.index] = c;
+        }
+        else
+        {
+            s.index = static_cast<std::uint32_t>(sh.slots.size());
+            sh.slots.push_back(c);
+        }
+    }
+
+    m_ById.insert_or_assign(c->uuid(), c);
+    m_Size.fetch_add(1, std::memory_order_relaxed);
+    c->registered(this, s);
+}
+
+void connection_registry::remove(slot s)
+{
+    //the pointer is released outside the lock since it may be the last one
+    std::shared_ptr<connection> removed;
+    shard& sh = *m_Shards[s.shard];
+    {
+        std::scoped_lock lock(sh.mutex);
+        if (s.index >= sh.slots.size() || !sh.slots[s.index])
+            return;
+
+        removed.swap(sh.slots[s.index]);
+        sh.free.push_back(s.index);
+    }
+
+    m_ById.erase(removed->uuid());
+    m_Size.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::shared_ptr<connection> connection_registry::find(const boost::uuids::uuid& id) const
+{
+    if (auto c = m_ById.find(id))
+        return c->lock();
+    return nullptr;
+}
+
+std::size_t connection_registry::size() const
+{
+    return m_Size.load(std::memory_order_relaxed);
+}
+
+void connection_registry::for_each(const std::function<void(const std::shared_ptr<connection>&)>& func)
+{
+    for (auto& sh : m_Shards)
+    {
+        std::scoped_lock lock(sh->mutex);
+        for (const auto& c : sh->slots)
+            if (c) func(c);
+    }
+}
+
+void connection_registry::clear()
+{
+    for (auto& sh : m_Shards)
+    {
+        std::scoped_lock lock(sh->mutex);
+        sh->slots.clear();
+        sh->free.clear();
+    }
+    m_ById.clear();
+    m_Size = 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <boost/uuid/uuid.hpp>
+#include "ts_hash_map.h"
+
+//ahead declaration of the connection class
+class connection;
+
+//registry of the live connections
+//it's a slot map: each connection gets a slot when it's added and removes
+//itself when it's closed, both in O(1), so there are no dead entries and no
+//thread sweeping them
+//the slots are split in shards, each one with it's own lock, so the accepts
+//and the closes of different io threads don't contend on the same mutex
+//-------
+//the connections are also indexed by their uuid, so they can be found from
+//any thread (targeted sends, admin kicks, per client stats) without a scan
+class connection_registry
+{
+public:
+    struct slot
+    {
+        std::uint32_t shard = 0;
+        std::uint32_t index = 0;
+    };
+
+    explicit connection_registry(std::size_t shards = 1);
+    connection_registry(const connection_registry&) = delete;
+
+    //adds the connection and tells it it's slot
+    void add(const std::shared_ptr<connection>& c);
+
+    //removes the connection of the slot
+    void remove(slot s);
+
+    //finds a live connection by it's uuid, returns null if there is none
+    std::shared_ptr<connection> find(const boost::uuids::uuid& id) const;
+
+    //number of live connections
+    std::size_t size() const;
+
+    //calls the function for each live connection
+    void for_each(const std::function<void(const std::shared_ptr<connection>&)>& func);
+
+    //removes all the connections
+    void clear();
+
+private:
+    struct alignas(64) shard
+    {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<connection>> slots;
+        //indexes of the empty slots
+        std::vector<std::uint32_t> free;
+    };
+
+    struct uuid_hash
+    {
+        std::size_t operator()(const boost::uuids::uuid& id) const { return boost::uuids::hash_value(id); }
+    };
+
+    std::vector<std::unique_ptr<shard>> m_Shards;
+    //the index only holds weak pointers, the slots own the connections
+    ts_hash_map<boost::uuids::uuid, std::weak_ptr<connection>, uuid_hash> m_ById;
+    std::atomic<std::size_t> m_Next = 0;
+    std::atomic<std::size_t> m_Size = 0;
+};
@@ -0,0 +1,87 @@
+#include <array>
+#include <cstring>
+#include "crc32c.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_X86 1
+#endif
+
+//reflected castagnoli polynomial
+static constexpr std::uint32_t polynomial = 0x82f63b78;
+
+static constexpr std::array<std::uint32_t, 256> make_table()
+{
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t i = 0; i < 256; ++i)
+    {
+        std::uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+        table[i] = crc;
+    }
+    return table;
+}
+
+static constexpr std::array<std::uint32_t, 256> table = make_table();
+
+static std::uint32_t crc32c_software(const std::uint8_t* data, std::size_t size, std::uint32_t crc)
+{
+    for (std::size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef CRC32C_X86
+//8 bytes per instruction, the unaligned head and the tail byte by byte
+__attribute__((target("sse4.2")))
+static std::uint32_t crc32c_sse42(const std::uint8_t* data, std::size_t size, std::uint32_t crc)
+{
+    while (size > 0 && reinterpret_cast<std::uintptr_t>(data) % 8 != 0)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+        --size;
+    }
+
+#if defined(__x86_64__)
+    std::uint64_t crc64 = crc;
+    while (size >= 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = static_cast<std::uint32_t>(crc64);
+#endif
+
+    while (size > 0)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+        --size;
+    }
+    return crc;
+}
+#endif
+
+bool crc32c_hardware()
+{
+#ifdef CRC32C_X86
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+std::uint32_t crc32c(const void* data, std::size_t size, std::uint32_t crc)
+{
+    auto* bytes = static_cast<const std::uint8_t*>(data);
+    crc = ~crc;
+#ifdef CRC32C_X86
+    if (crc32c_hardware())
+        return ~crc32c_sse42(bytes, size, crc);
+#endif
+    return ~crc32c_software(bytes, size, crc);
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+//crc32c (castagnoli), the checksum of the binary segment records
+//uses the sse4.2 crc32 instruction when the cpu has it (checked once at runtime,
+//so the build doesn't need -msse4.2) and a table otherwise
+
+//continues the crc of the previous data, the first call uses crc = 0
+std::uint32_t crc32c(const void* data, std::size_t size, std::uint32_t crc = 0);
+
+//the sse4.2 instruction is used
+bool crc32c_hardware();
@@ -0,0 +1,60 @@
+#include "io_context_pool.h"
+
+io_context_pool::io_context_pool(std::size_t threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    m_Contexts.reserve(threads);
+    m_Work.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        //each context is only run by one thread, so we hint asio
+        //that it doesn't need to lock it's internal queues
+        m_Contexts.emplace_back(std::make_unique<asio::io_context>(1));
+        m_Work.emplace_back(asio::make_work_guard(*m_Contexts.back()));
+    }
+}
+
+io_context_pool::~io_context_pool()
+{
+    stop();
+}
+
+void io_context_pool::run()
+{
+    m_Threads.reserve(m_Contexts.size());
+    for (auto& context : m_Contexts)
+        m_Threads.emplace_back([&context]() { context->run(); });
+}
+
+void io_context_pool::stop()
+{
+    m_Work.clear();
+    for (auto& context : m_Contexts)
+        context->stop();
+
+    for (auto& thread : m_Threads)
+        if (thread.joinable()) thread.join();
+    m_Threads.clear();
+}
+
+asio::io_context& io_context_pool::get_io_context()
+{
+    return *m_Contexts[next_index()];
+}
+
+std::size_t io_context_pool::next_index()
+{
+    return m_Next.fetch_add(1, std::memory_order_relaxed) % m_Contexts.size();
+}
+
+asio::io_context& io_context_pool::get_io_context(std::size_t i)
+{
+    return *m_Contexts[i % m_Contexts.size()];
+}
+
+std::size_t io_context_pool::size() const
+{
+    return m_Contexts.size();
+}
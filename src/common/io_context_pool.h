@@ -0,0 +1,48 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <boost/asio.hpp>
+
+using namespace boost;
+
+//pool of io contexts where each context is run by it's own thread
+//a connection is bound to a single context for it's whole life, so all of
+//it's handlers run on the same thread and are serialized without a strand
+class io_context_pool
+{
+public:
+    //if threads is 0 we use one context per hardware thread
+    explicit io_context_pool(std::size_t threads = 0);
+    io_context_pool(const io_context_pool&) = delete;
+    ~io_context_pool();
+
+    //starts one thread per context
+    void run();
+
+    //stops all the contexts and joins the threads
+    void stop();
+
+    //gets the next context in a round robin fashion
+    asio::io_context& get_io_context();
+
+    //index of the next context in the round robin
+    std::size_t next_index();
+
+    //gets a specific context
+    asio::io_context& get_io_context(std::size_t i);
+
+    //number of contexts (and threads) in the pool
+    std::size_t size() const;
+
+private:
+    using work_guard = asio::executor_work_guard<asio::io_context::executor_type>;
+
+    std::vector<std::unique_ptr<asio::io_context>> m_Contexts;
+    //keeps the contexts alive even if they run out of tasks
+    std::vector<work_guard> m_Work;
+    std::vector<std::thread> m_Threads;
+    std::atomic<std::size_t> m_Next = 0;
+};
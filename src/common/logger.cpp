@@ -0,0 +1,264 @@
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include "logger.h"
+
+//how often the flush thread wakes
+static constexpr std::chrono::milliseconds flush_interval{ 5 };
+
+static std::int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+log_level log_level_from_string(const std::string& level)
+{
+    if (level == "trace") return log_level::trace;
+    if (level == "debug") return log_level::debug;
+    if (level == "info") return log_level::info;
+    if (level == "warn") return log_level::warn;
+    if (level == "error") return log_level::error;
+    if (level == "off") return log_level::off;
+    throw std::invalid_argument("invalid log level: " + level);
+}
+
+logger& logger::instance()
+{
+    static logger instance;
+    return instance;
+}
+
+logger::logger()
+{
+    m_Thread = std::thread([this]() { flusher(); });
+}
+
+logger::~logger()
+{
+    {
+        std::scoped_lock lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_CV.notify_one();
+    if (m_Thread.joinable()) m_Thread.join();
+}
+
+void logger::set_level(log_level level)
+{
+    m_Level.store(level, std::memory_order_relaxed);
+}
+
+void logger::set_rate_limit(std::size_t linesPerSecond)
+{
+    if (linesPerSecond == 0)
+    {
+        m_Interval.store(0, std::memory_order_relaxed);
+        return;
+    }
+
+    std::int64_t interval = 1'000'000'000 / static_cast<std::int64_t>(linesPerSecond);
+    m_Burst.store(interval * static_cast<std::int64_t>(linesPerSecond), std::memory_order_relaxed);
+    m_Interval.store(std::max<std::int64_t>(1, interval), std::memory_order_relaxed);
+}
+
+bool logger::acquire_token(std::int64_t now)
+{
+    std::int64_t interval = m_Interval.load(std::memory_order_relaxed);
+    if (interval == 0)
+        return true;
+
+    //the line is allowed if the arrival time isn't more than a burst ahead of now
+    std::int64_t arrival = m_Arrival.load(std::memory_order_relaxed);
+    while (true)
+    {
+        std::int64_t next = std::max(arrival, now) + interval;
+        if (next - now > m_Burst.load(std::memory_order_relaxed))
+            return false;
+        if (m_Arrival.compare_exchange_weak(arrival, next, std::memory_order_relaxed))
+            return true;
+    }
+}
+
+logger::thread_buffer& logger::local_buffer()
+{
+    //the thread and the logger share the buffer, so the lines of
+    //an exited thread are still flushed
+    thread_local std::shared_ptr<thread_buffer> buffer = [this]()
+    {
+        auto b = std::make_shared<thread_buffer>();
+        std::scoped_lock lock(m_BuffersMutex);
+        m_Buffers.push_back(b);
+        return b;
+    }();
+    return *buffer;
+}
+
+void logger::write(log_level level, std::string_view line)
+{
+    if (!enabled(level))
+        return;
+
+    std::int64_t now = now_ns();
+    if (!acquire_token(now))
+    {
+        m_RateDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (!line.empty() && line.back() == '\n')
+        line.remove_suffix(1);
+    line = line.substr(0, max_line);
+
+    thread_buffer& b = local_buffer();
+    record_header header{ static_cast<std::uint32_t>(line.size()), level, now };
+    std::size_t needed = sizeof(header) + line.size();
+
+    //only this thread writes the tail, the head is released by the flush thread
+    std::size_t tail = b.tail.load(std::memory_order_relaxed);
+    std::size_t head = b.head.load(std::memory_order_acquire);
+    if (thread_buffer::capacity - (tail - head) < needed)
+    {
+        b.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    //copies to the ring, wrapping around the end
+    auto copy = [&b](std::size_t position, const void* data, std::size_t size)
+    {
+        std::size_t offset = position % thread_buffer::capacity;
+        std::size_t first = std::min(size, thread_buffer::capacity - offset);
+        std::memcpy(b.data.get() + offset, data, first);
+        std::memcpy(b.data.get(), static_cast<const char*>(data) + first, size - first);
+    };
+    copy(tail, &header, sizeof(header));
+    copy(tail + sizeof(header), line.data(), line.size());
+
+    b.tail.store(tail + needed, std::memory_order_release);
+}
+
+void logger::flusher()
+{
+    std::unique_lock lock(m_Mutex);
+    while (!m_Stop)
+    {
+        lock.unlock();
+        flush();
+        lock.lock();
+        m_CV.wait_for(lock, flush_interval, [this]() { return m_Stop; });
+    }
+    lock.unlock();
+
+    //the lines written until the logger was destroyed
+    while (flush());
+}
+
+//writes the whole string, ignoring errors (there is nowhere to report them)
+static void write_fd(int fd, const std::string& text)
+{
+    std::size_t written = 0;
+    while (written < text.size())
+    {
+        ssize_t n = ::write(fd, text.data() + written, text.size() - written);
+        if (n <= 0)
+            return;
+        written += n;
+    }
+}
+
+bool logger::flush()
+{
+    std::vector<std::shared_ptr<thread_buffer>> buffers;
+    {
+        std::scoped_lock lock(m_BuffersMutex);
+        buffers = m_Buffers;
+    }
+
+    //info and below go to stdout, warnings and errors to stderr
+    std::string out, err;
+    std::uint64_t dropped = m_RateDropped.exchange(0, std::memory_order_relaxed);
+    std::uint64_t full = 0;
+
+    for (auto& b : buffers)
+    {
+        full += b->dropped.exchange(0, std::memory_order_relaxed);
+
+        std::size_t head = b->head.load(std::memory_order_relaxed);
+        std::size_t tail = b->tail.load(std::memory_order_acquire);
+        auto copy = [&b](std::size_t position, void* data, std::size_t size)
+        {
+            std::size_t offset = position % thread_buffer::capacity;
+            std::size_t first = std::min(size, thread_buffer::capacity - offset);
+            std::memcpy(data, b->data.get() + offset, first);
+            std::memcpy(static_cast<char*>(data) + first, b->data.get(), size - first);
+        };
+
+        while (head != tail)
+        {
+            record_header header;
+            copy(head, &header, sizeof(header));
+
+            //time of the line with milliseconds
+            //the formatted seconds are cached since most lines share them
+            std::time_t seconds = header.time / 1'000'000'000;
+            if (seconds != m_PrefixSeconds)
+            {
+                std::tm tm;
+                localtime_r(&seconds, &tm);
+                m_PrefixLength = std::strftime(m_Prefix, sizeof(m_Prefix), "%H:%M:%S", &tm);
+                m_PrefixSeconds = seconds;
+            }
+            char prefix[32];
+            std::memcpy(prefix, m_Prefix, m_PrefixLength);
+            std::snprintf(prefix + m_PrefixLength, sizeof(prefix) - m_PrefixLength, ".%03lld ", static_cast<long long>(header.time / 1'000'000 % 1000));
+
+            std::string& stream = header.level >= log_level::warn ? err : out;
+            stream += prefix;
+            std::size_t at = stream.size();
+            stream.resize(at + header.size);
+            copy(head + sizeof(header), stream.data() + at, header.size);
+            stream += '\n';
+
+            head += sizeof(header) + header.size;
+        }
+        b->head.store(head, std::memory_order_release);
+    }
+
+    //buffers of the threads that exited, already flushed
+    {
+        std::scoped_lock lock(m_BuffersMutex);
+        std::erase_if(m_Buffers, [](const std::shared_ptr<thread_buffer>& b)
+            {
+                return b.use_count() == 2 && b->head.load(std::memory_order_relaxed) == b->tail.load(std::memory_order_acquire);
+            });
+    }
+
+    if (dropped > 0)
+        err += "[LOG] " + std::to_string(dropped) + " lines dropped by the rate limit\n";
+    if (full > 0)
+        err += "[LOG] " + std::to_string(full) + " lines dropped, the buffer was full\n";
+
+    if (!out.empty()) write_fd(STDOUT_FILENO, out);
+    if (!err.empty()) write_fd(STDERR_FILENO, err);
+
+    return !out.empty() || !err.empty();
+}
+
+log_line::log_line(log_level level) :
+    m_Level(level)
+{
+    if (!logger::instance().enabled(level))
+        return;
+
+    thread_local std::ostringstream stream;
+    stream.str(std::string());
+    stream.clear();
+    m_Stream = &stream;
+}
+
+log_line::~log_line()
+{
+    if (m_Stream)
+        logger::instance().write(m_Level, m_Stream->view());
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+
+//asynchronous logger
+//the threads never write to the console, each one appends it's lines to it's
+//own lock free buffer (single producer, single consumer) and a background
+//thread writes all the buffers every few milliseconds with a write per stream
+//-------
+//the logging threads never wait: a line is dropped if the thread's buffer
+//is full or if the rate limit is exceeded, the flush thread reports how
+//many lines were dropped
+
+enum class log_level
+{
+    trace, debug, info, warn, error, off
+};
+
+//parses the level name, throws if it's invalid
+log_level log_level_from_string(const std::string& level);
+
+class logger
+{
+public:
+    //the process logger, created (and it's thread started) at the first use
+    static logger& instance();
+
+    logger(const logger&) = delete;
+    //writes everything still buffered
+    ~logger();
+
+    void set_level(log_level level);
+    bool enabled(log_level level) const
+    {
+        return level >= m_Level.load(std::memory_order_relaxed);
+    }
+
+    //maximum lines per second (with a burst of one second), 0 is unlimited
+    void set_rate_limit(std::size_t linesPerSecond);
+
+    //appends the line to the calling thread's buffer
+    void write(log_level level, std::string_view line);
+
+private:
+    logger();
+
+    //buffer of a thread
+    //the records are [header][line] and wrap around the end of the ring
+    struct thread_buffer
+    {
+        static constexpr std::size_t capacity = 256 * 1024;
+
+        std::unique_ptr<char[]> data = std::make_unique<char[]>(capacity);
+        //written by the thread
+        alignas(64) std::atomic<std::size_t> tail = 0;
+        //written by the flush thread
+        alignas(64) std::atomic<std::size_t> head = 0;
+        std::atomic<std::uint64_t> dropped = 0;
+    };
+
+    struct record_header
+    {
+        std::uint32_t size;
+        log_level level;
+        //system clock nanoseconds
+        std::int64_t time;
+    };
+
+    //longest line, the rest is cut
+    static constexpr std::size_t max_line = thread_buffer::capacity / 8;
+
+    //buffer of the calling thread, registered at it's first line
+    thread_buffer& local_buffer();
+
+    //takes a token from the rate limiter
+    bool acquire_token(std::int64_t now);
+
+    //flush thread loop
+    void flusher();
+
+    //writes all the buffered lines, returns false if there was nothing
+    bool flush();
+
+    std::atomic<log_level> m_Level = log_level::info;
+
+    //rate limit as a GCRA (the token bucket as a single "theoretical arrival time")
+    //each line moves it an interval forward and it can't be more than a burst ahead
+    std::atomic<std::int64_t> m_Interval = 0;
+    std::atomic<std::int64_t> m_Burst = 0;
+    std::atomic<std::int64_t> m_Arrival = 0;
+    std::atomic<std::uint64_t> m_RateDropped = 0;
+
+    //buffers of all the threads, the ones of exited threads are
+    //released after they are flushed
+    std::mutex m_BuffersMutex;
+    std::vector<std::shared_ptr<thread_buffer>> m_Buffers;
+
+    //time prefix of the last flushed second (only used by the flush thread)
+    std::int64_t m_PrefixSeconds = -1;
+    char m_Prefix[16] = {};
+    std::size_t m_PrefixLength = 0;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_CV;
+    bool m_Stop = false;
+    std::thread m_Thread;
+};
+
+//a line being written, it's sent to the logger when destroyed
+//if the level is disabled nothing is formatted
+class log_line
+{
+public:
+    explicit log_line(log_level level);
+    log_line(const log_line&) = delete;
+    ~log_line();
+
+    template<typename T>
+    log_line& operator<<(const T& value)
+    {
+        if (m_Stream)
+            *m_Stream << value;
+        return *this;
+    }
+
+private:
+    log_level m_Level;
+    //reused stream of the thread, null if the level is disabled
+    std::ostringstream* m_Stream = nullptr;
+};
+
+inline log_line log_debug() { return log_line(log_level::debug); }
+inline log_line log_info() { return log_line(log_level::info); }
+inline log_line log_warn() { return log_line(log_level::warn); }
+inline log_line log_error() { return log_line(log_level::error); }
@@ -0,0 +1,163 @@
+#include <sstream>
+#include <bit>
+#include "metrics.h"
+
+std::size_t metrics_detail::thread_shard()
+{
+    //each new thread takes the next shard
+    static std::atomic<std::size_t> next = 0;
+    thread_local std::size_t shard = next.fetch_add(1, std::memory_order_relaxed) % shards;
+    return shard;
+}
+
+std::uint64_t metrics_counter::value() const
+{
+    std::uint64_t total = 0;
+    for (const auto& s : m_Shards)
+        total += s.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+metrics_histogram::metrics_histogram()
+{
+    for (auto& s : m_Shards)
+    {
+        s.counts = std::make_unique<std::atomic<std::uint64_t>[]>(bucket_count);
+        for (std::size_t i = 0; i < bucket_count; ++i)
+            s.counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+std::size_t metrics_histogram::bucket_of(std::uint64_t value)
+{
+    //the first sub_buckets values have their own bucket
+    if (value < sub_buckets)
+        return value;
+
+    //the others keep the sub_bits most significant bits, so each power
+    //of two range [2^m, 2^(m+1)) has sub_buckets / 2 buckets
+    std::size_t msb = 63 - std::countl_zero(value);
+    std::size_t shift = msb - sub_bits + 1;
+    std::size_t sub = value >> shift;
+    return sub_buckets + (shift - 1) * (sub_buckets / 2) + (sub - sub_buckets / 2);
+}
+
+std::uint64_t metrics_histogram::highest_of(std::size_t bucket)
+{
+    if (bucket < sub_buckets)
+        return bucket;
+
+    std::size_t shift = (bucket - sub_buckets) / (sub_buckets / 2) + 1;
+    std::uint64_t sub = (bucket - sub_buckets) % (sub_buckets / 2) + sub_buckets / 2;
+    return ((sub + 1) << shift) - 1;
+}
+
+void metrics_histogram::record(std::uint64_t value)
+{
+    shard& s = m_Shards[metrics_detail::thread_shard()];
+    s.counts[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    s.count.fetch_add(1, std::memory_order_relaxed);
+    s.sum.fetch_add(value, std::memory_order_relaxed);
+
+    std::uint64_t max = s.max.load(std::memory_order_relaxed);
+    while (value > max && !s.max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+}
+
+metrics_histogram::snapshot metrics_histogram::read() const
+{
+    snapshot snap;
+    snap.counts.resize(bucket_count);
+    for (const auto& s : m_Shards)
+    {
+        for (std::size_t i = 0; i < bucket_count; ++i)
+            snap.counts[i] += s.counts[i].load(std::memory_order_relaxed);
+        snap.count += s.count.load(std::memory_order_relaxed);
+        snap.sum += s.sum.load(std::memory_order_relaxed);
+        snap.max = std::max(snap.max, s.max.load(std::memory_order_relaxed));
+    }
+    return snap;
+}
+
+std::uint64_t metrics_histogram::snapshot::quantile(double q) const
+{
+    if (count == 0)
+        return 0;
+
+    //rank of the value, the bucket that reaches it holds the quantile
+    std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(q * count + 0.5));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts.size(); ++i)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+            return std::min(highest_of(i), max);
+    }
+    return max;
+}
+
+double metrics_histogram::snapshot::mean() const
+{
+    return count == 0 ? 0.0 : static_cast<double>(sum) / count;
+}
+
+metrics_counter& metrics_registry::counter(const std::string& name, const std::string& help)
+{
+    std::scoped_lock lock(m_Mutex);
+    entry& e = m_Entries.emplace_back();
+    e.name = name;
+    e.help = help;
+    e.counter = std::make_unique<metrics_counter>();
+    return *e.counter;
+}
+
+metrics_histogram& metrics_registry::histogram(const std::string& name, const std::string& help)
+{
+    std::scoped_lock lock(m_Mutex);
+    entry& e = m_Entries.emplace_back();
+    e.name = name;
+    e.help = help;
+    e.histogram = std::make_unique<metrics_histogram>();
+    return *e.histogram;
+}
+
+void metrics_registry::gauge(const std::string& name, const std::string& help, std::function<double()> func)
+{
+    std::scoped_lock lock(m_Mutex);
+    entry& e = m_Entries.emplace_back();
+    e.name = name;
+    e.help = help;
+    e.gauge = std::move(func);
+}
+
+std::string metrics_registry::to_prometheus() const
+{
+    std::scoped_lock lock(m_Mutex);
+    std::ostringstream out;
+
+    for (const entry& e : m_Entries)
+    {
+        out << "# HELP " << e.name << " " << e.help << "\n";
+        if (e.counter)
+        {
+            out << "# TYPE " << e.name << " counter\n";
+            out << e.name << " " << e.counter->value() << "\n";
+        }
+        else if (e.gauge)
+        {
+            out << "# TYPE " << e.name << " gauge\n";
+            out << e.name << " " << e.gauge() << "\n";
+        }
+        else if (e.histogram)
+        {
+            //nanoseconds to seconds
+            metrics_histogram::snapshot snap = e.histogram->read();
+            out << "# TYPE " << e.name << " summary\n";
+            for (double q : { 0.5, 0.9, 0.99, 0.999, 1.0 })
+                out << e.name << "{quantile=\"" << q << "\"} " << snap.quantile(q) / 1e9 << "\n";
+            out << e.name << "_sum " << snap.sum / 1e9 << "\n";
+            out << e.name << "_count " << snap.count << "\n";
+        }
+    }
+
+    return out.str();
+}
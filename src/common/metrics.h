@@ -0,0 +1,123 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <functional>
+#include <cstdint>
+
+//low overhead metrics
+//every metric is split in shards (one cache line each) and each thread
+//updates only it's own shard with relaxed atomics, so the hot path never
+//contends, the shards are only summed when the metrics are read
+
+namespace metrics_detail
+{
+    //number of shards of every metric, the threads are spread among them
+    static constexpr std::size_t shards = 16;
+
+    //index of the calling thread's shard
+    std::size_t thread_shard();
+}
+
+//monotonic counter
+class metrics_counter
+{
+public:
+    void inc(std::uint64_t n = 1)
+    {
+        m_Shards[metrics_detail::thread_shard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t value() const;
+
+private:
+    struct alignas(64) shard
+    {
+        std::atomic<std::uint64_t> value = 0;
+    };
+
+    std::array<shard, metrics_detail::shards> m_Shards;
+};
+
+//histogram with HDR (log linear) buckets
+//the values below sub_buckets have their own bucket, the others are split in
+//power of two ranges of sub_buckets / 2 linear buckets each, so the relative
+//error of any value is below 2/sub_buckets (1/32) no matter the magnitude,
+//with a fixed number of buckets
+class metrics_histogram
+{
+public:
+    static constexpr std::size_t sub_bits = 6;
+    static constexpr std::size_t sub_buckets = 1 << sub_bits;
+    static constexpr std::size_t bucket_count = sub_buckets + (64 - sub_bits) * (sub_buckets / 2);
+
+    metrics_histogram();
+
+    void record(std::uint64_t value);
+
+    //merged view of all the shards
+    struct snapshot
+    {
+        std::vector<std::uint64_t> counts;
+        std::uint64_t count = 0;
+        std::uint64_t sum = 0;
+        std::uint64_t max = 0;
+
+        //value at the quantile q (0 to 1), it's the highest value of the bucket
+        std::uint64_t quantile(double q) const;
+        double mean() const;
+    };
+
+    snapshot read() const;
+
+    //bucket of a value and the highest value of a bucket
+    static std::size_t bucket_of(std::uint64_t value);
+    static std::uint64_t highest_of(std::size_t bucket);
+
+private:
+    struct alignas(64) shard
+    {
+        std::unique_ptr<std::atomic<std::uint64_t>[]> counts;
+        std::atomic<std::uint64_t> count = 0;
+        std::atomic<std::uint64_t> sum = 0;
+        std::atomic<std::uint64_t> max = 0;
+    };
+
+    std::array<shard, metrics_detail::shards> m_Shards;
+};
+
+//named metrics exposed as prometheus text
+//the histograms hold nanoseconds and are exposed as summaries in seconds
+class metrics_registry
+{
+public:
+    metrics_registry() = default;
+    metrics_registry(const metrics_registry&) = delete;
+
+    //the returned references are valid for the registry's life
+    metrics_counter& counter(const std::string& name, const std::string& help);
+    metrics_histogram& histogram(const std::string& name, const std::string& help);
+
+    //gauge read by calling the function when the metrics are exposed
+    void gauge(const std::string& name, const std::string& help, std::function<double()> func);
+
+    //prometheus text exposition format
+    std::string to_prometheus() const;
+
+private:
+    struct entry
+    {
+        std::string name;
+        std::string help;
+        std::unique_ptr<metrics_counter> counter;
+        std::unique_ptr<metrics_histogram> histogram;
+        std::function<double()> gauge;
+    };
+
+    mutable std::mutex m_Mutex;
+    std::vector<entry> m_Entries;
+};
@@ -0,0 +1,227 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+//lock free bounded multi producer / single consumer queue
+//it's a ring of cells where each cell has a sequence number that tells if it's
+//free for the producer of that position or ready for the consumer, so producers
+//only compete for the tail position (one compare exchange) and never lock
+//-------
+//the consumer can block (wait function) when the queue is empty, it announces
+//it's sleeping and waits on an atomic (futex), the producers only notify it
+//when that flag is set, so a busy queue never makes a system call
+//-------
+//when the queue is full the producers sleep until there is room (backpressure):
+//they count themselves as waiting and wait on a sequence (futex) that the consumer
+//bumps after freeing cells, only when someone is waiting
+//T must be default constructible since the cells are created upfront
+template<typename T>
+class mpsc_queue
+{
+public:
+    //the capacity is rounded up to a power of two
+    explicit mpsc_queue(std::size_t capacity = 65536)
+    {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+
+        m_Mask = size - 1;
+        m_Cells = std::make_unique<cell[]>(size);
+        for (std::size_t i = 0; i < size; ++i)
+            m_Cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mpsc_queue(const mpsc_queue&) = delete;
+
+    //----------- PRODUCERS -------------
+    //tries to push the value, fails if the queue is full
+    bool try_push(T&& val)
+    {
+        std::size_t pos = m_Tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell& c = m_Cells[pos & m_Mask];
+            std::size_t sequence = c.sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+
+            //the cell is free for this position, we try to claim it
+            if (diff == 0)
+            {
+                if (m_Tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    c.value = std::move(val);
+                    c.sequence.store(pos + 1, std::memory_order_release);
+                    notify();
+                    return true;
+                }
+            }
+            //the consumer didn't free the cell yet, so the queue is full
+            else if (diff < 0)
+                return false;
+            //another producer took the position
+            else
+                pos = m_Tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    //pushes the value, sleeping until there is room if the queue is full
+    void push_back(T&& val)
+    {
+        while (!try_push(std::move(val)))
+        {
+            //the sequence is read before announcing the wait and checking again,
+            //room freed after the check changes it and the wait returns at once
+            //the fence pairs with the one in notify_producers
+            std::uint32_t freed = m_Freed.load(std::memory_order_relaxed);
+            m_Waiting.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool pushed = try_push(std::move(val));
+            if (!pushed)
+                m_Freed.wait(freed, std::memory_order_relaxed);
+            m_Waiting.fetch_sub(1, std::memory_order_relaxed);
+            if (pushed)
+                return;
+        }
+    }
+
+    void push_back(const T& val)
+    {
+        push_back(T(val));
+    }
+
+    template<typename... Args>
+    void emplace_back(Args&&... args)
+    {
+        push_back(T(std::forward<Args>(args)...));
+    }
+    //----------- PRODUCERS -------------
+
+    //------------ CONSUMER -------------
+    //tries to pop the front value, fails if the queue is empty
+    bool try_pop(T& out)
+    {
+        std::size_t pos = m_Head.load(std::memory_order_relaxed);
+        cell& c = m_Cells[pos & m_Mask];
+        if (c.sequence.load(std::memory_order_acquire) != pos + 1)
+            return false;
+
+        out = std::move(c.value);
+        //frees the cell for the producer of the next lap
+        c.sequence.store(pos + m_Mask + 1, std::memory_order_release);
+        m_Head.store(pos + 1, std::memory_order_relaxed);
+        notify_producers();
+        return true;
+    }
+
+    //moves up to max values from the front to the container
+    //returns how many were moved
+    template<typename Container>
+    std::size_t drain_into(Container& out, std::size_t max = std::numeric_limits<std::size_t>::max())
+    {
+        std::size_t pos = m_Head.load(std::memory_order_relaxed);
+        std::size_t count = 0;
+        for (; count < max; ++count, ++pos)
+        {
+            cell& c = m_Cells[pos & m_Mask];
+            if (c.sequence.load(std::memory_order_acquire) != pos + 1)
+                break;
+
+            out.push_back(std::move(c.value));
+            c.sequence.store(pos + m_Mask + 1, std::memory_order_release);
+        }
+        m_Head.store(pos, std::memory_order_relaxed);
+        if (count > 0)
+            notify_producers();
+        return count;
+    }
+
+    //pops the front value, the queue must not be empty
+    T pop_front()
+    {
+        T temp;
+        try_pop(temp);
+        return temp;
+    }
+
+    bool empty() const
+    {
+        std::size_t pos = m_Head.load(std::memory_order_relaxed);
+        return m_Cells[pos & m_Mask].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    //blocks until the queue has at least one value
+    void wait()
+    {
+        while (empty())
+        {
+            //announces it's going to sleep and checks again, a producer that
+            //pushed before seeing the flag is caught by the second check
+            //the fence pairs with the one in notify
+            m_Sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!empty())
+            {
+                m_Sleeping.store(false, std::memory_order_relaxed);
+                return;
+            }
+            m_Sleeping.wait(true, std::memory_order_relaxed);
+        }
+    }
+    //------------ CONSUMER -------------
+
+    //approximate number of values, can be called from any thread
+    std::size_t size() const
+    {
+        std::size_t head = m_Head.load(std::memory_order_relaxed);
+        std::size_t tail = m_Tail.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    std::size_t capacity() const
+    {
+        return m_Mask + 1;
+    }
+
+private:
+    //wakes the consumer if it's sleeping
+    void notify()
+    {
+        //pairs with the store of the flag in wait, so either we see the flag
+        //or the consumer sees the value we just published
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_Sleeping.load(std::memory_order_relaxed) && m_Sleeping.exchange(false, std::memory_order_relaxed))
+            m_Sleeping.notify_one();
+    }
+
+    //wakes the producers waiting for room, if any
+    void notify_producers()
+    {
+        //pairs with the fence in push_back, so either we see the waiting
+        //producer or it sees the cells we just freed
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_Waiting.load(std::memory_order_relaxed) == 0)
+            return;
+        m_Freed.fetch_add(1, std::memory_order_relaxed);
+        m_Freed.notify_all();
+    }
+
+    struct cell
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<cell[]> m_Cells;
+    std::size_t m_Mask;
+
+    //each position in it's own cache line so the producers
+    //and the consumer don't invalidate each other
+    alignas(64) std::atomic<std::size_t> m_Tail = 0;
+    alignas(64) std::atomic<std::size_t> m_Head = 0;
+    alignas(64) std::atomic<bool> m_Sleeping = false;
+    //producers waiting for room and the sequence they wait on
+    alignas(64) std::atomic<std::uint32_t> m_Waiting = 0;
+    std::atomic<std::uint32_t> m_Freed = 0;
+};
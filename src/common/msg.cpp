@@ -24,8 +24,53 @@ void msg::set(const std::string& data)
 	memcpy(body.data(), data.c_str(), s);
 }
 
+void msg::set_identity(const std::string& id)
+{
+	//control type + identity, without the null terminator
+	uint32_t s = id.length() + 1;
+	header.size = s | msg_header::control_bit;
+	body.resize(s);
+	body[0] = static_cast<uint8_t>(control_type::identity);
+	memcpy(body.data() + 1, id.data(), id.length());
+}
+
 std::string msg::get() const
 {
 	//reinterpret cast it to a char* that can be casted to a std::string
 	return std::string(reinterpret_cast<const char*>(body.data()));
 }
+
+msg_buffer::msg_buffer(std::shared_ptr<const uint8_t[]> data, std::size_t offset, std::size_t size) :
+	m_Data(std::move(data)),
+	m_Offset(offset),
+	m_Size(size)
+{
+}
+
+const uint8_t* msg_buffer::data() const
+{
+	return m_Data.get() + m_Offset;
+}
+
+std::size_t msg_buffer::size() const
+{
+	return m_Size;
+}
+
+bool msg_buffer::empty() const
+{
+	return m_Size == 0;
+}
+
+std::string_view msg_buffer::view() const
+{
+	//same as msg::get, the text ends at the null terminator
+	//but it's bounded by the size in case the sender didn't add it
+	const char* text = reinterpret_cast<const char*>(data());
+	return std::string_view(text, strnlen(text, m_Size));
+}
+
+std::string_view msg_buffer::bytes() const
+{
+	return std::string_view(reinterpret_cast<const char*>(data()), m_Size);
+}
@@ -3,6 +3,9 @@
 #include <vector>
 #include <memory>
 #include <cstring>
+#include <string_view>
+#include <chrono>
+#include <cstdint>
 
 //message represantation
 //we use a header because we know it has a fixed number of bytes
@@ -11,7 +14,21 @@
 
 struct msg_header
 {
+	//the highest bit of the size marks a control frame, which isn't a
+	//client message, the body of a control frame starts with it's type
+	static constexpr uint32_t control_bit = 0x8000'0000;
+
 	uint32_t size = 0;
+
+	bool is_control() const { return (size & control_bit) != 0; }
+	uint32_t body_size() const { return size & ~control_bit; }
+};
+
+enum class control_type : uint8_t
+{
+	//handshake, the rest of the body is the client's identity
+	//must be the first frame of the connection
+	identity = 1
 };
 
 struct msg
@@ -26,16 +43,68 @@ struct msg
 	//set the body with std::string
 	void set(const std::string& data);
 
+	//makes the identity handshake frame
+	void set_identity(const std::string& id);
+
 	//get the message out of the vector
 	std::string get() const;
 };
 
+//reference counted slice of a received buffer
+//all the messages parsed from the same read share the buffer, so the body
+//goes from the socket to the storage without being copied
+//the bytes of a slice are never modified while it's alive
+class msg_buffer
+{
+public:
+	msg_buffer() = default;
+	msg_buffer(std::shared_ptr<const uint8_t[]> data, std::size_t offset, std::size_t size);
+
+	const uint8_t* data() const;
+	std::size_t size() const;
+	bool empty() const;
+
+	//get the message as text (up to the null terminator) without copying it
+	std::string_view view() const;
+	//the whole body, null bytes included, without copying it
+	std::string_view bytes() const;
+
+private:
+	std::shared_ptr<const uint8_t[]> m_Data;
+	std::size_t m_Offset = 0;
+	std::size_t m_Size = 0;
+};
+
+//timestamps of the stages a received message goes through
+//in nanoseconds of the steady clock (CLOCK_MONOTONIC, read without
+//a system call), 0 means the stage wasn't reached
+struct msg_trace
+{
+	//the header was complete in the receive buffer
+	uint64_t headerRead = 0;
+	//the body was complete in the receive buffer
+	uint64_t bodyComplete = 0;
+	//pushed to the ingest queue
+	uint64_t queuePush = 0;
+	//taken from the ingest queue by the dispatcher
+	uint64_t dequeue = 0;
+	//written (and synced if the durability mode requires it) by the storage
+	uint64_t writeComplete = 0;
+
+	static uint64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+};
+
 //ahead declaration of the connection class
 class connection;
 
 //message + owner
+//an empty message is pushed when the owner connection is closed
 struct msg_owner
 {
 	std::shared_ptr<connection> owner;
-	msg message;
+	msg_buffer message;
+	msg_trace trace;
 };
@@ -0,0 +1,90 @@
+#include <cstring>
+#include "shared_log.h"
+#include "crc32c.h"
+
+void shared_log::append_header(std::string& out, const char (&kind)[8], std::uint64_t created)
+{
+    file_header header;
+    std::memcpy(header.magic, kind, sizeof(kind));
+    header.created = created;
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void shared_log::append_record(std::string& out, record_kind kind, std::uint32_t client,
+    std::uint64_t timestamp, std::string_view body)
+{
+    record_header header;
+    header.length = static_cast<std::uint32_t>(body.size());
+    header.client = client;
+    header.kind = kind;
+    header.timestamp = timestamp;
+    header.crc = record_crc(header, body.data());
+
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.append(body);
+}
+
+std::uint32_t shared_log::record_crc(const record_header& header, const void* body)
+{
+    //the crc field itself is skipped
+    std::uint32_t crc = crc32c(&header.length, sizeof(header.length));
+    crc = crc32c(&header.client, sizeof(header.client) + sizeof(header.kind) + sizeof(header.timestamp), crc);
+    return crc32c(body, header.length, crc);
+}
+
+std::uint64_t shared_log::read_header(const std::uint8_t* data, std::size_t size, const char (&kind)[8])
+{
+    file_header header;
+    if (size < sizeof(header) || std::memcmp(data, kind, sizeof(kind)) != 0)
+        return 0;
+    std::memcpy(&header, data, sizeof(header));
+    return header.created;
+}
+
+const char* shared_log::to_string(scan_error error)
+{
+    switch (error)
+    {
+    case scan_error::none: return "ok";
+    case scan_error::header: return "not a shared log";
+    case scan_error::torn: return "incomplete last record";
+    case scan_error::checksum: return "checksum mismatch";
+    }
+    return "unknown";
+}
+
+std::size_t shared_log::scan(const std::uint8_t* data, std::size_t begin, std::size_t end,
+    const visitor& visit, scan_error& error)
+{
+    error = scan_error::none;
+    std::size_t position = begin;
+    while (end - position >= sizeof(record_header))
+    {
+        //the records aren't aligned, the header is copied
+        record_header header;
+        std::memcpy(&header, data + position, sizeof(header));
+        if (header.length == 0)
+            return position;
+
+        const std::uint8_t* body = data + position + sizeof(header);
+        if (header.length > end - position - sizeof(header))
+        {
+            error = scan_error::torn;
+            return position;
+        }
+        if (record_crc(header, body) != header.crc)
+        {
+            error = scan_error::checksum;
+            return position;
+        }
+
+        if (visit)
+            visit(header, position, std::string_view(reinterpret_cast<const char*>(body), header.length));
+        position += sizeof(header) + header.length;
+    }
+
+    //a partial header at the end
+    if (position < end)
+        error = scan_error::torn;
+    return position;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+
+//layout of the shared logs, where all the clients of a storage writer are
+//appended to the same sequential file instead of one directory per client
+//a file header followed by the records, each one a record header and it's body
+//-------
+//the clients are numbered per log: the first record of a client in a log
+//declares it's number (the body is the client's id), it's messages only carry
+//the number, so the id isn't repeated in every record
+//-------
+//each log has a sidecar index (same name, .idx) with fixed size entries: for
+//each batch, one entry per client with the byte range of it's records in the log
+//(the records of other clients may be between them) and their time range, and
+//one entry per declaration, so the stream of a client is found without reading
+//the whole log. The index isn't synced with the log, the records after the
+//last indexed one are found by scanning the log's tail
+//the integers are written in the native order (little endian)
+namespace shared_log
+{
+    //extensions of the log and index files
+    constexpr std::string_view extension = ".log";
+    constexpr std::string_view index_extension = ".idx";
+
+    constexpr char magic[8] = { 'B', 'R', 'K', 'L', 'O', 'G', '0', '1' };
+    constexpr char index_magic[8] = { 'B', 'R', 'K', 'I', 'D', 'X', '0', '1' };
+
+    //same header for the log and it's index (with their own magic)
+    struct file_header
+    {
+        char magic[8];
+        //nanoseconds since the unix epoch when the log was created, orders the logs
+        std::uint64_t created;
+    };
+
+    enum class record_kind : std::uint32_t
+    {
+        message = 0,
+        //the body is the id of the client
+        client = 1
+    };
+
+    struct record_header
+    {
+        //body size, 0 is never written (empty messages and ids aren't stored)
+        //so it marks the end of the records
+        std::uint32_t length;
+        //crc32c of the other fields and the body
+        std::uint32_t crc;
+        //number of the client in this log
+        std::uint32_t client;
+        record_kind kind;
+        //nanoseconds since the unix epoch when the record was stored
+        std::uint64_t timestamp;
+    };
+
+    struct index_entry
+    {
+        std::uint32_t client;
+        //messages in the range, 0 for a declaration
+        std::uint32_t records;
+        //byte range of the records in the log
+        std::uint64_t begin;
+        std::uint64_t end;
+        //timestamps of the first and last record
+        std::uint64_t first;
+        std::uint64_t last;
+    };
+
+    static_assert(sizeof(file_header) == 16);
+    static_assert(sizeof(record_header) == 24);
+    static_assert(sizeof(index_entry) == 40);
+
+    //appends the header of a log or of an index
+    void append_header(std::string& out, const char (&kind)[8], std::uint64_t created);
+
+    //appends a record
+    void append_record(std::string& out, record_kind kind, std::uint32_t client,
+        std::uint64_t timestamp, std::string_view body);
+
+    //checksum of a record
+    std::uint32_t record_crc(const record_header& header, const void* body);
+
+    //the file starts with the header of the given kind, returns it's creation time (0 if not)
+    std::uint64_t read_header(const std::uint8_t* data, std::size_t size, const char (&kind)[8]);
+
+    enum class scan_error
+    {
+        none,
+        //not a shared log
+        header,
+        //the last record is incomplete (the file was cut while it was written)
+        torn,
+        //a record doesn't match it's checksum
+        checksum
+    };
+
+    const char* to_string(scan_error error);
+
+    //called for every valid record with it's position in the log
+    using visitor = std::function<void(const record_header&, std::size_t, std::string_view)>;
+
+    //checks the records of a log in memory (usually mapped) from begin until end,
+    //the end of the records or the first invalid one
+    //returns the position after the last valid record
+    std::size_t scan(const std::uint8_t* data, std::size_t begin, std::size_t end,
+        const visitor& visit, scan_error& error);
+}
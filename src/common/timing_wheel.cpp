@@ -0,0 +1,80 @@
+#include "timing_wheel.h"
+#include "connection.h"
+
+timing_wheel::timing_wheel(asio::io_context& context, std::chrono::milliseconds timeout, std::chrono::milliseconds resolution) :
+    m_Timer(context),
+    m_Resolution(std::max(resolution, std::chrono::milliseconds(1))),
+    //the timeout is rounded up to a whole number of ticks
+    m_Timeout(std::max<std::uint64_t>(1, (timeout + m_Resolution - std::chrono::milliseconds(1)) / m_Resolution))
+{
+    //one slot per tick of the timeout (plus the current one), so a connection
+    //is checked once per timeout period if it keeps active
+    m_Slots.resize(m_Timeout + 1);
+}
+
+void timing_wheel::start()
+{
+    m_Timer.expires_after(m_Resolution);
+    m_Timer.async_wait([this](const boost::system::error_code& error)
+        {
+            if (!error)
+                sweep_task();
+        });
+}
+
+void timing_wheel::add(const std::shared_ptr<connection>& c)
+{
+    std::scoped_lock lock(m_MutexSlots);
+    slot(now() + m_Timeout).push_back(c);
+}
+
+std::uint64_t timing_wheel::now() const
+{
+    return m_Tick.load(std::memory_order_relaxed);
+}
+
+void timing_wheel::sweep_task()
+{
+    std::uint64_t tick = m_Tick.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    //the expired connections are disconnected after
+    //releasing the lock
+    std::vector<std::shared_ptr<connection>> expired;
+    {
+        std::scoped_lock lock(m_MutexSlots);
+        std::vector<std::weak_ptr<connection>> expiring;
+        expiring.swap(slot(tick));
+
+        for (auto& entry : expiring)
+        {
+            //the connection was already closed (or destroyed)
+            //so it just leaves the wheel
+            std::shared_ptr<connection> c = entry.lock();
+            if (!c || !c->is_connected())
+                continue;
+
+            //still active, goes to the slot of it's new deadline
+            std::uint64_t deadline = c->last_activity() + m_Timeout;
+            if (deadline > tick)
+                slot(deadline).push_back(std::move(entry));
+            else
+                expired.push_back(std::move(c));
+        }
+    }
+
+    for (auto& c : expired)
+        c->disconnect();
+
+    //schedules the next tick from the last expiration so the wheel doesn't drift
+    m_Timer.expires_at(m_Timer.expiry() + m_Resolution);
+    m_Timer.async_wait([this](const boost::system::error_code& error)
+        {
+            if (!error)
+                sweep_task();
+        });
+}
+
+std::vector<std::weak_ptr<connection>>& timing_wheel::slot(std::uint64_t tick)
+{
+    return m_Slots[tick % m_Slots.size()];
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <boost/asio.hpp>
+
+using namespace boost;
+
+//ahead declaration of the connection class
+class connection;
+
+//hashed timing wheel shared by all the connections for the idle timeout
+//instead of one timer per connection (that is rescheduled at every message)
+//the connection only stores the tick of it's last activity, which is O(1)
+//the wheel is swept once per tick and the slot of the current tick is checked:
+//the connections that were active since they were added to the slot are moved
+//to the slot of their new deadline and the expired ones are disconnected
+//a connection expires within one tick (the resolution) of the timeout
+class timing_wheel
+{
+public:
+    timing_wheel(asio::io_context& context, std::chrono::milliseconds timeout, std::chrono::milliseconds resolution);
+    timing_wheel(const timing_wheel&) = delete;
+
+    //starts the periodic sweep
+    void start();
+
+    //adds a connection to the wheel, can be called from any thread
+    void add(const std::shared_ptr<connection>& c);
+
+    //current tick, used by the connections to mark their activity
+    std::uint64_t now() const;
+
+private:
+    //task that advances the wheel one tick and checks the current slot
+    void sweep_task();
+
+    //slot for a deadline tick
+    std::vector<std::weak_ptr<connection>>& slot(std::uint64_t tick);
+
+    asio::steady_timer m_Timer;
+    std::chrono::milliseconds m_Resolution;
+    //timeout in ticks
+    std::uint64_t m_Timeout;
+
+    std::atomic<std::uint64_t> m_Tick = 0;
+    std::vector<std::vector<std::weak_ptr<connection>>> m_Slots;
+    std::mutex m_MutexSlots;
+};
@@ -0,0 +1 @@
+#include "ts_hash_map.h"
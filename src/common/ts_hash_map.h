@@ -0,0 +1,98 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+
+//add thread safety to unordered_map
+//the map is split in shards (by the key hash), each one with it's own shared mutex
+//so lookups only take a shared lock on one shard and never block each other, and
+//inserts/erases only block the lookups of the same shard
+template<typename K, typename V, typename Hash = std::hash<K>>
+class ts_hash_map
+{
+public:
+    explicit ts_hash_map(std::size_t shards = 64)
+    {
+        m_Shards.reserve(std::max<std::size_t>(1, shards));
+        for (std::size_t i = 0; i < std::max<std::size_t>(1, shards); ++i)
+            m_Shards.emplace_back(std::make_unique<shard>());
+    }
+    ts_hash_map(const ts_hash_map&) = delete;
+
+    void insert_or_assign(const K& key, V val)
+    {
+        shard& s = get_shard(key);
+        std::unique_lock lock(s.mutex);
+        s.map.insert_or_assign(key, std::move(val));
+    }
+
+    bool erase(const K& key)
+    {
+        shard& s = get_shard(key);
+        std::unique_lock lock(s.mutex);
+        return s.map.erase(key) > 0;
+    }
+
+    //returns a copy of the value, since it may be erased
+    //by another thread right after the lookup
+    std::optional<V> find(const K& key) const
+    {
+        const shard& s = get_shard(key);
+        std::shared_lock lock(s.mutex);
+        auto it = s.map.find(key);
+        if (it == s.map.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    bool contains(const K& key) const
+    {
+        const shard& s = get_shard(key);
+        std::shared_lock lock(s.mutex);
+        return s.map.find(key) != s.map.end();
+    }
+
+    std::size_t size() const
+    {
+        std::size_t total = 0;
+        for (const auto& s : m_Shards)
+        {
+            std::shared_lock lock(s->mutex);
+            total += s->map.size();
+        }
+        return total;
+    }
+
+    void clear()
+    {
+        for (auto& s : m_Shards)
+        {
+            std::unique_lock lock(s->mutex);
+            s->map.clear();
+        }
+    }
+
+private:
+    struct alignas(64) shard
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<K, V, Hash> map;
+    };
+
+    shard& get_shard(const K& key)
+    {
+        return *m_Shards[Hash()(key) % m_Shards.size()];
+    }
+
+    const shard& get_shard(const K& key) const
+    {
+        return *m_Shards[Hash()(key) % m_Shards.size()];
+    }
+
+    std::vector<std::unique_ptr<shard>> m_Shards;
+};
@@ -4,12 +4,17 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
+#include <limits>
+#include <algorithm>
 
 //add thread safety to deque
 //basically add scope locks in all the operations
 //and the ones that add things in the container (push_back, emplace_back, ...)
 //we use a contion variable to notify the thread waiting (wait function) for this resource
 //to check the condition and unlock the mutex if condition is met
+//the container lock is released before taking the condition variable lock, since wait
+//takes them in the opposite order (the predicate locks the container)
 template<typename T>
 class ts_queue 
 {
@@ -48,8 +53,10 @@ public:
 
     void push_front(T&& val)
     {
-        std::scoped_lock sLock(m_MutexQueue);
-        m_Queue.push_front(std::move(val));
+        {
+            std::scoped_lock sLock(m_MutexQueue);
+            m_Queue.push_front(std::move(val));
+        }
 
         std::unique_lock uLock(m_MutexCV);
         m_CV.notify_one();
@@ -57,8 +64,10 @@ public:
 
     void push_back(T&& val)
     {
-        std::scoped_lock sLock(m_MutexQueue);
-        m_Queue.push_back(std::move(val));
+        {
+            std::scoped_lock sLock(m_MutexQueue);
+            m_Queue.push_back(std::move(val));
+        }
 
         std::unique_lock uLock(m_MutexCV);
         m_CV.notify_one();
@@ -66,8 +75,10 @@ public:
 
     void push_front(const T& val)
     {
-        std::scoped_lock sLock(m_MutexQueue);
-        m_Queue.push_front(val);
+        {
+            std::scoped_lock sLock(m_MutexQueue);
+            m_Queue.push_front(val);
+        }
 
         std::unique_lock uLock(m_MutexCV);
         m_CV.notify_one();
@@ -75,8 +86,10 @@ public:
 
     void push_back(const T& val)
     {
-        std::scoped_lock sLock(m_MutexQueue);
-        m_Queue.push_back(val);
+        {
+            std::scoped_lock sLock(m_MutexQueue);
+            m_Queue.push_back(val);
+        }
 
         std::unique_lock uLock(m_MutexCV);
         m_CV.notify_one();
@@ -85,8 +98,10 @@ public:
     template<typename... Args>
     void emplace_front(Args&&... args)
     {
-        std::scoped_lock sLock(m_MutexQueue);
-        m_Queue.emplace_front(std::forward<Args>(args)...);
+        {
+            std::scoped_lock sLock(m_MutexQueue);
+            m_Queue.emplace_front(std::forward<Args>(args)...);
+        }
 
         std::unique_lock uLock(m_MutexCV);
         m_CV.notify_one();
@@ -95,13 +110,53 @@ public:
     template<typename... Args>
     void emplace_back(Args&&... args)
     {
-        std::scoped_lock sLock(m_MutexQueue);
-        m_Queue.emplace_back(std::forward<Args>(args)...);
+        {
+            std::scoped_lock sLock(m_MutexQueue);
+            m_Queue.emplace_back(std::forward<Args>(args)...);
+        }
 
         std::unique_lock uLock(m_MutexCV);
         m_CV.notify_one();
     }
 
+    //appends all the values of the container with a single lock and notification
+    template<typename Container>
+    void append(Container&& values)
+    {
+        {
+            std::scoped_lock sLock(m_MutexQueue);
+            for (auto& val : values)
+                m_Queue.push_back(std::move(val));
+        }
+
+        std::unique_lock uLock(m_MutexCV);
+        m_CV.notify_one();
+    }
+
+    //moves up to max values from the front to the container with a single lock
+    //returns how many were moved
+    template<typename Container>
+    std::size_t drain_into(Container& out, std::size_t max = std::numeric_limits<std::size_t>::max())
+    {
+        std::scoped_lock lock(m_MutexQueue);
+        std::size_t count = std::min(max, m_Queue.size());
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out.push_back(std::move(m_Queue.front()));
+            m_Queue.pop_front();
+        }
+        return count;
+    }
+
+    //takes everything in the queue by swapping it with an empty one
+    std::deque<T> pop_all()
+    {
+        std::deque<T> temp;
+        std::scoped_lock lock(m_MutexQueue);
+        temp.swap(m_Queue);
+        return temp;
+    }
+
     bool empty()
     {
         std::scoped_lock lock(m_MutexQueue);
@@ -126,6 +181,15 @@ public:
         m_CV.wait(lock, [this]() { return !empty(); });
     }
 
+    //same as wait but gives up after the timeout
+    //returns if the queue has something
+    template<typename Rep, typename Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout)
+    {
+        std::unique_lock lock(m_MutexCV);
+        return m_CV.wait_for(lock, timeout, [this]() { return !empty(); });
+    }
+
 private:
     std::deque<T> m_Queue;
     std::condition_variable m_CV;
@@ -12,6 +12,8 @@
 //and the ones that add things in the container (push_back, emplace_back, ...)
 //we use a contion variable to notify the thread waiting (wait function) for this resource
 //to check the condition and unlock the mutex if condition is met
+//the container lock is released before taking the condition variable lock, since wait
+//takes them in the opposite order (the predicate locks the container)
 template<typename T>
 class ts_vector 
 {
@@ -22,8 +24,10 @@ public:
 
     void push_back(T&& val)
     {
-        std::scoped_lock sLock(m_MutexVector);
-        m_Vector.push_back(std::move(val));
+        {
+            std::scoped_lock sLock(m_MutexVector);
+            m_Vector.push_back(std::move(val));
+        }
 
         std::unique_lock uLock(m_MutexCV);
         m_CV.notify_one();
@@ -31,8 +35,10 @@ public:
 
     void push_back(const T& val)
     {
-        std::scoped_lock sLock(m_MutexVector);
-        m_Vector.push_back(val);
+        {
+            std::scoped_lock sLock(m_MutexVector);
+            m_Vector.push_back(val);
+        }
 
         std::unique_lock uLock(m_MutexCV);
         m_CV.notify_one();
@@ -41,8 +47,10 @@ public:
     template<typename... Args>
     void emplace_back(Args&&... args)
     {
-        std::scoped_lock sLock(m_MutexVector);
-        m_Vector.emplace_back(std::forward<Args>(args)...);
+        {
+            std::scoped_lock sLock(m_MutexVector);
+            m_Vector.emplace_back(std::forward<Args>(args)...);
+        }
 
         std::unique_lock uLock(m_MutexCV);
         m_CV.notify_one();
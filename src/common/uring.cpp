@@ -0,0 +1,474 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "uring.h"
+#include "logger.h"
+
+//the op is kept in the low bits of the handler pointer
+static constexpr std::uint64_t op_mask = 7;
+
+static int uring_setup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int uring_register(int fd, unsigned opcode, void* arg, unsigned count)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+//the rings are shared with the kernel, the indexes it writes are
+//read with acquire and the ones we write are published with release
+static unsigned load_acquire(unsigned* p)
+{
+    return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire);
+}
+
+static void store_release(unsigned* p, unsigned value)
+{
+    std::atomic_ref<unsigned>(*p).store(value, std::memory_order_release);
+}
+
+bool uring::supported()
+{
+    io_uring_params params{};
+    int fd = uring_setup(4, &params);
+    if (fd < 0)
+        return false;
+    ::close(fd);
+    //single mmap and the non dropping completion queue (5.5+)
+    //are assumed by this implementation
+    return (params.features & IORING_FEAT_SINGLE_MMAP) && (params.features & IORING_FEAT_NODROP);
+}
+
+uring::uring(const options& o)
+{
+    m_Params.flags = IORING_SETUP_CQSIZE;
+    m_Params.cq_entries = o.entries * 4;
+    m_Fd = uring_setup(o.entries, &m_Params);
+    if (m_Fd < 0)
+        throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+
+    //the submission and completion rings share the mapping
+    m_SqMapSize = m_Params.sq_off.array + m_Params.sq_entries * sizeof(unsigned);
+    m_CqMapSize = m_Params.cq_off.cqes + m_Params.cq_entries * sizeof(io_uring_cqe);
+    m_SqMapSize = m_CqMapSize = std::max(m_SqMapSize, m_CqMapSize);
+    m_SqMap = ::mmap(nullptr, m_SqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, IORING_OFF_SQ_RING);
+    if (m_SqMap == MAP_FAILED)
+    {
+        int error = errno;
+        m_SqMap = nullptr;
+        ::close(m_Fd);
+        throw std::system_error(error, std::generic_category(), "io_uring mmap");
+    }
+    m_CqMap = m_SqMap;
+
+    m_SqesSize = m_Params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, m_SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_Fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        int error = errno;
+        ::munmap(m_SqMap, m_SqMapSize);
+        ::close(m_Fd);
+        throw std::system_error(error, std::generic_category(), "io_uring mmap");
+    }
+    m_Sqes = static_cast<io_uring_sqe*>(sqes);
+
+    auto* sq = static_cast<char*>(m_SqMap);
+    m_SqHead = reinterpret_cast<unsigned*>(sq + m_Params.sq_off.head);
+    m_SqTail = reinterpret_cast<unsigned*>(sq + m_Params.sq_off.tail);
+    m_SqMask = reinterpret_cast<unsigned*>(sq + m_Params.sq_off.ring_mask);
+    m_SqFlags = reinterpret_cast<unsigned*>(sq + m_Params.sq_off.flags);
+    m_SqArray = reinterpret_cast<unsigned*>(sq + m_Params.sq_off.array);
+
+    auto* cq = static_cast<char*>(m_CqMap);
+    m_CqHead = reinterpret_cast<unsigned*>(cq + m_Params.cq_off.head);
+    m_CqTail = reinterpret_cast<unsigned*>(cq + m_Params.cq_off.tail);
+    m_CqMask = reinterpret_cast<unsigned*>(cq + m_Params.cq_off.ring_mask);
+    m_Cqes = reinterpret_cast<io_uring_cqe*>(cq + m_Params.cq_off.cqes);
+
+    if (o.buffers == 0)
+        return;
+
+    //provided buffers, the ring of descriptors is page aligned memory
+    //registered as buffer group 0
+    m_BufCount = o.buffers;
+    m_BufSize = o.bufferSize;
+    m_BufRingSize = m_BufCount * sizeof(io_uring_buf);
+    void* ring = ::mmap(nullptr, m_BufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        int error = errno;
+        release();
+        throw std::system_error(error, std::generic_category(), "io_uring buffer ring");
+    }
+    m_BufRing = static_cast<io_uring_buf_ring*>(ring);
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<std::uint64_t>(m_BufRing);
+    reg.ring_entries = m_BufCount;
+    reg.bgid = 0;
+    if (uring_register(m_Fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        int error = errno;
+        release();
+        throw std::system_error(error, std::generic_category(), "io_uring register buffers");
+    }
+
+    m_Buffers = std::make_unique_for_overwrite<std::uint8_t[]>(m_BufCount * m_BufSize);
+    for (unsigned i = 0; i < m_BufCount; ++i)
+        recycle(static_cast<std::uint16_t>(i));
+
+    //the registration succeeds on kernels without multishot receives (5.19),
+    //the connections would fail every receive
+    int probe = probe_buffer_ring();
+    if (probe == -EINVAL)
+    {
+        release();
+        throw std::system_error(EINVAL, std::generic_category(), "io_uring multishot receive");
+    }
+
+    //some kernels accept the registration but never pick a buffer from
+    //the ring (every receive fails with ENOBUFS), those get the buffers
+    //with the older provide buffers operation instead
+    if (probe != -ENOBUFS)
+        return;
+
+    log_warn() << "[URING] Provided buffer ring not usable, using provide buffers";
+    uring_register(m_Fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    ::munmap(m_BufRing, m_BufRingSize);
+    m_BufRing = nullptr;
+
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(m_BufCount);
+    sqe->addr = reinterpret_cast<std::uint64_t>(m_Buffers.get());
+    sqe->len = static_cast<std::uint32_t>(m_BufSize);
+    sqe->buf_group = 0;
+    sqe->off = 0;
+    io_uring_cqe cqe = wait_internal();
+    if (cqe.res < 0)
+    {
+        release();
+        throw std::system_error(-cqe.res, std::generic_category(), "io_uring provide buffers");
+    }
+}
+
+int uring::probe_buffer_ring()
+{
+    int pair[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0)
+        return 0;
+
+    char byte = 0;
+    int result = 0;
+    if (::write(pair[1], &byte, 1) == 1)
+    {
+        io_uring_sqe* sqe = next_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = pair[0];
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->buf_group = 0;
+        io_uring_cqe cqe = wait_internal();
+        result = cqe.res;
+
+        //the receive stays armed until the peer closes
+        bool more = cqe.flags & IORING_CQE_F_MORE;
+        if (more)
+        {
+            ::close(pair[1]);
+            pair[1] = -1;
+        }
+        while (true)
+        {
+            if (cqe.flags & IORING_CQE_F_BUFFER)
+                recycle(static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+            if (!more)
+                break;
+            cqe = wait_internal();
+            more = cqe.flags & IORING_CQE_F_MORE;
+        }
+    }
+
+    ::close(pair[0]);
+    if (pair[1] >= 0)
+        ::close(pair[1]);
+    return result;
+}
+
+io_uring_cqe uring::wait_internal()
+{
+    //only used before the ring has handlers, the single completion
+    //is the one of the internal operation just queued
+    submit_and_wait(1);
+    unsigned head = *m_CqHead;
+    io_uring_cqe cqe = m_Cqes[head & *m_CqMask];
+    store_release(m_CqHead, head + 1);
+    return cqe;
+}
+
+uring::~uring()
+{
+    //the handlers of the operations that will never complete
+    //the map is moved since they may destroy themselves
+    auto pending = std::move(m_Pending);
+    m_Pending.clear();
+    for (auto& [handler, count] : pending)
+        handler->on_uring_abandon();
+
+    m_Event.reset();
+    release();
+}
+
+void uring::release()
+{
+    if (m_BufRing) ::munmap(m_BufRing, m_BufRingSize);
+    if (m_Sqes) ::munmap(m_Sqes, m_SqesSize);
+    if (m_SqMap) ::munmap(m_SqMap, m_SqMapSize);
+    if (m_Fd >= 0) ::close(m_Fd);
+    m_BufRing = nullptr;
+    m_Sqes = nullptr;
+    m_SqMap = nullptr;
+    m_Fd = -1;
+}
+
+void uring::start(asio::io_context& context)
+{
+    int event = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event < 0)
+        throw std::system_error(errno, std::generic_category(), "eventfd");
+    if (uring_register(m_Fd, IORING_REGISTER_EVENTFD, &event, 1) < 0)
+    {
+        int error = errno;
+        ::close(event);
+        throw std::system_error(error, std::generic_category(), "io_uring register eventfd");
+    }
+
+    m_Context = &context;
+    m_Event.emplace(context, event);
+    wait_task();
+}
+
+void uring::wait_task()
+{
+    m_Event->async_wait(asio::posix::stream_descriptor::wait_read,
+        [this](const boost::system::error_code& error)
+        {
+            if (error)
+                return;
+
+            //clears the signal before reaping, so a completion
+            //posted while reaping signals it again
+            std::uint64_t value;
+            while (::read(m_Event->native_handle(), &value, sizeof(value)) > 0);
+
+            reap();
+            //the handlers queued new operations, we submit them now
+            //instead of waiting for the end of the turn
+            submit();
+            wait_task();
+        });
+}
+
+void uring::reserve(unsigned count)
+{
+    //the queue is too full, what is queued must be submitted first
+    if (*m_SqTail - load_acquire(m_SqHead) + count <= m_Params.sq_entries)
+        return;
+
+    submit();
+    while (*m_SqTail - load_acquire(m_SqHead) + count > m_Params.sq_entries)
+    {
+        enter(0, 1, IORING_ENTER_GETEVENTS);
+        reap();
+        //the handlers may have queued operations
+        submit();
+    }
+}
+
+io_uring_sqe* uring::next_sqe()
+{
+    reserve(1);
+
+    unsigned tail = *m_SqTail;
+    unsigned index = tail & *m_SqMask;
+    io_uring_sqe* sqe = &m_Sqes[index];
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    m_SqArray[index] = index;
+    store_release(m_SqTail, tail + 1);
+    ++m_Queued;
+    return sqe;
+}
+
+io_uring_sqe* uring::prepare(uring_handler* handler, std::uint8_t op)
+{
+    io_uring_sqe* sqe = next_sqe();
+    sqe->user_data = reinterpret_cast<std::uint64_t>(handler) | (op & op_mask);
+
+    ++m_Pending[handler];
+    ++m_PendingTotal;
+
+    schedule_submit();
+    return sqe;
+}
+
+void uring::recv_multishot(uring_handler* handler, std::uint8_t op, int fd)
+{
+    io_uring_sqe* sqe = prepare(handler, op);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+}
+
+void uring::sendmsg(uring_handler* handler, std::uint8_t op, int fd, const msghdr* message)
+{
+    io_uring_sqe* sqe = prepare(handler, op);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(message);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+}
+
+const std::uint8_t* uring::buffer(std::uint16_t id) const
+{
+    return m_Buffers.get() + static_cast<std::size_t>(id) * m_BufSize;
+}
+
+void uring::recycle(std::uint16_t id)
+{
+    if (!m_BufRing)
+    {
+        //given back with an operation without handler (user_data 0)
+        io_uring_sqe* sqe = next_sqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = 1;
+        sqe->addr = reinterpret_cast<std::uint64_t>(buffer(id));
+        sqe->len = static_cast<std::uint32_t>(m_BufSize);
+        sqe->buf_group = 0;
+        sqe->off = id;
+        schedule_submit();
+        return;
+    }
+
+    //the tail is overlaid with the resv field of the first descriptor
+    //so only the other fields are written
+    io_uring_buf& buf = m_BufRing->bufs[m_BufTail & (m_BufCount - 1)];
+    buf.addr = reinterpret_cast<std::uint64_t>(buffer(id));
+    buf.len = static_cast<std::uint32_t>(m_BufSize);
+    buf.bid = id;
+    ++m_BufTail;
+    std::atomic_ref<std::uint16_t>(m_BufRing->tail).store(m_BufTail, std::memory_order_release);
+}
+
+void uring::schedule_submit()
+{
+    //without a context the owner submits
+    if (!m_Context || m_SubmitScheduled)
+        return;
+
+    m_SubmitScheduled = true;
+    asio::post(*m_Context, [this]() { submit(); });
+}
+
+int uring::enter(unsigned submit, unsigned wait, unsigned flags)
+{
+    int result;
+    do
+        result = static_cast<int>(::syscall(__NR_io_uring_enter, m_Fd, submit, wait, flags, nullptr, 0));
+    while (result < 0 && errno == EINTR);
+    return result;
+}
+
+void uring::submit()
+{
+    m_SubmitScheduled = false;
+    while (m_Queued > 0)
+    {
+        int submitted = enter(m_Queued, 0, 0);
+        if (submitted >= 0)
+        {
+            m_Queued -= submitted;
+            continue;
+        }
+
+        //the completion queue is full, it needs to be emptied first
+        if (errno == EBUSY || errno == EAGAIN)
+        {
+            reap();
+            continue;
+        }
+
+        log_error() << "[URING] Failed to submit: " << std::strerror(errno);
+        return;
+    }
+}
+
+void uring::submit_and_wait(unsigned count)
+{
+    m_SubmitScheduled = false;
+    unsigned queued = m_Queued;
+    int result = enter(queued, count, IORING_ENTER_GETEVENTS);
+    if (result >= 0)
+        m_Queued -= std::min<unsigned>(queued, result);
+}
+
+std::size_t uring::reap()
+{
+    std::size_t reaped = 0;
+    while (true)
+    {
+        unsigned head = *m_CqHead;
+        unsigned tail = load_acquire(m_CqTail);
+        while (head != tail)
+        {
+            //copied and released before the handler runs
+            //so the handler can queue more work
+            io_uring_cqe cqe = m_Cqes[head & *m_CqMask];
+            store_release(m_CqHead, ++head);
+            ++reaped;
+
+            //the buffers given back have no handler
+            if (cqe.user_data == 0)
+            {
+                if (cqe.res < 0)
+                    log_error() << "[URING] Failed to provide buffer: " << std::strerror(-cqe.res);
+                continue;
+            }
+
+            auto* handler = reinterpret_cast<uring_handler*>(cqe.user_data & ~op_mask);
+            std::uint8_t op = static_cast<std::uint8_t>(cqe.user_data & op_mask);
+
+            //the last completion of the operation
+            if (!(cqe.flags & IORING_CQE_F_MORE))
+            {
+                auto it = m_Pending.find(handler);
+                if (it != m_Pending.end() && --it->second == 0)
+                    m_Pending.erase(it);
+                --m_PendingTotal;
+            }
+
+            handler->on_uring(op, cqe.res, cqe.flags);
+        }
+
+        //the completions that didn't fit are kept by the kernel
+        //and only moved to the queue when we enter
+        if (!(load_acquire(m_SqFlags) & IORING_SQ_CQ_OVERFLOW))
+            break;
+        enter(0, 0, IORING_ENTER_GETEVENTS);
+    }
+    return reaped;
+}
+
+std::size_t uring::pending() const
+{
+    return m_PendingTotal;
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <boost/asio.hpp>
+
+using namespace boost;
+
+//receives the completions of the operations submitted to an uring
+//op is the value given when the operation was submitted, so a handler
+//can tell it's operations apart
+class uring_handler
+{
+public:
+    //called on the ring's thread for every completion
+    //flags has IORING_CQE_F_MORE if the operation will complete again (multishot)
+    virtual void on_uring(std::uint8_t op, int result, std::uint32_t flags) = 0;
+
+    //called when the ring is destroyed with operations of the handler still pending
+    //they will never complete
+    virtual void on_uring_abandon() = 0;
+
+protected:
+    ~uring_handler() = default;
+};
+
+//minimal io_uring, made with the system calls (liburing isn't a dependency)
+//a ring is used by a single thread: the operations are queued in the submission
+//ring and submitted together (one io_uring_enter for all the operations queued
+//by the handlers of a turn), the completions are dispatched to their handlers
+//-------
+//it can run inside an io_context: the ring signals an eventfd on every
+//completion and the context waits on it like any other descriptor, so the
+//asio handlers (timers, accepts) and the ring completions share the thread
+//-------
+//the receives use a ring of provided buffers (buffer group 0): the kernel picks
+//a free buffer when data arrives, so idle connections don't hold a buffer
+class uring
+{
+public:
+    struct options
+    {
+        //submission queue size, the completion queue is 4 times bigger
+        unsigned entries = 1024;
+        //provided buffers (power of two, 0 for none) and their size
+        unsigned buffers = 0;
+        std::size_t bufferSize = 16 * 1024;
+    };
+
+    //the kernel supports io_uring (and it isn't disabled)
+    static bool supported();
+
+    //throws std::system_error if the ring can't be created
+    explicit uring(const options& o);
+    uring(const uring&) = delete;
+    ~uring();
+
+    //dispatches the completions from the context's thread
+    //after this the ring must only be used from that thread
+    void start(asio::io_context& context);
+
+    //------------- OPERATIONS ---------------
+    //multishot receive with provided buffers
+    //every completion has the buffer (IORING_CQE_F_BUFFER) that must be recycled
+    void recv_multishot(uring_handler* handler, std::uint8_t op, int fd);
+
+    //sends the message (MSG_NOSIGNAL), it must be valid until it completes
+    void sendmsg(uring_handler* handler, std::uint8_t op, int fd, const msghdr* message);
+
+    //a zeroed entry for any other operation, with the handler set
+    //it's submitted with the others
+    io_uring_sqe* prepare(uring_handler* handler, std::uint8_t op);
+    //------------- OPERATIONS ---------------
+
+    //provided buffer of a completion and it's return to the kernel
+    const std::uint8_t* buffer(std::uint16_t id) const;
+    void recycle(std::uint16_t id);
+
+    //makes room for count operations in the submission queue, submitting what
+    //is queued (and handling completions) if it's needed, so the next count
+    //operations prepared don't submit anything: a linked chain isn't split
+    //between two submissions and no completion is handled while preparing it
+    void reserve(unsigned count);
+
+    //submits the queued operations
+    void submit();
+
+    //submits the queued operations and waits for at least count completions
+    //(without a context)
+    void submit_and_wait(unsigned count);
+
+    //dispatches the available completions, returns how many
+    std::size_t reap();
+
+    //operations submitted and not completed
+    std::size_t pending() const;
+
+private:
+    //------------- TASKS ---------------
+    //task to wait for the eventfd signal of new completions
+    void wait_task();
+    //------------- TASKS ---------------
+
+    //submission is deferred to the end of the current turn of the context
+    //so the operations queued by all the handlers go together
+    void schedule_submit();
+
+    int enter(unsigned submit, unsigned wait, unsigned flags);
+
+    //a zeroed entry queued for submission, without handler
+    io_uring_sqe* next_sqe();
+
+    //multishot receive on a socket pair, the way the connections receive
+    //returns it's result: -EINVAL without multishot receives (before 6.0),
+    //-ENOBUFS if the kernel doesn't pick the buffers from the ring
+    int probe_buffer_ring();
+    //submits and takes the completion of an internal operation
+    io_uring_cqe wait_internal();
+
+    //unmaps and closes everything (also used when the constructor fails)
+    void release();
+
+    int m_Fd = -1;
+    io_uring_params m_Params{};
+
+    //submission ring
+    void* m_SqMap = nullptr;
+    std::size_t m_SqMapSize = 0;
+    unsigned* m_SqHead = nullptr;
+    unsigned* m_SqTail = nullptr;
+    unsigned* m_SqMask = nullptr;
+    unsigned* m_SqFlags = nullptr;
+    unsigned* m_SqArray = nullptr;
+    io_uring_sqe* m_Sqes = nullptr;
+    std::size_t m_SqesSize = 0;
+    unsigned m_Queued = 0;
+
+    //completion ring
+    void* m_CqMap = nullptr;
+    std::size_t m_CqMapSize = 0;
+    unsigned* m_CqHead = nullptr;
+    unsigned* m_CqTail = nullptr;
+    unsigned* m_CqMask = nullptr;
+    io_uring_cqe* m_Cqes = nullptr;
+
+    //provided buffers, the ring is null when they are
+    //given back with the provide buffers operation
+    io_uring_buf_ring* m_BufRing = nullptr;
+    std::size_t m_BufRingSize = 0;
+    unsigned m_BufCount = 0;
+    std::size_t m_BufSize = 0;
+    std::uint16_t m_BufTail = 0;
+    std::unique_ptr<std::uint8_t[]> m_Buffers;
+
+    //operations pending of each handler, the ones left are abandoned
+    //when the ring is destroyed
+    std::unordered_map<uring_handler*, std::size_t> m_Pending;
+    std::size_t m_PendingTotal = 0;
+
+    //context integration
+    asio::io_context* m_Context = nullptr;
+    std::optional<asio::posix::stream_descriptor> m_Event;
+    bool m_SubmitScheduled = false;
+};
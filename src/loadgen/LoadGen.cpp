@@ -0,0 +1,243 @@
+#include <thread>
+#include <sstream>
+#include <stdexcept>
+#include <iomanip>
+#include "LoadGen.h"
+
+size_distribution::size_distribution(const std::string& description) :
+	m_Description(description)
+{
+	//kind:arg1:arg2
+	std::vector<std::string> parts;
+	std::stringstream stream(description);
+	for (std::string part; std::getline(stream, part, ':');)
+		parts.push_back(part);
+
+	try
+	{
+		if (parts.size() == 2 && parts[0] == "fixed")
+		{
+			m_Kind = kind::fixed;
+			m_Min = m_Max = std::stoull(parts[1]);
+		}
+		else if (parts.size() == 3 && parts[0] == "uniform")
+		{
+			m_Kind = kind::uniform;
+			m_Min = std::stoull(parts[1]);
+			m_Max = std::stoull(parts[2]);
+		}
+		else if (parts.size() == 2 && parts[0] == "exp")
+		{
+			m_Kind = kind::exponential;
+			m_Mean = std::stod(parts[1]);
+			m_Min = 1;
+			m_Max = 1024 * 1024;
+		}
+		else
+			throw std::invalid_argument("");
+	}
+	catch (const std::exception&)
+	{
+		throw std::invalid_argument("invalid size distribution: " + description);
+	}
+
+	//at least the null terminator
+	m_Min = std::max<std::size_t>(1, m_Min);
+	if (m_Max < m_Min || m_Mean <= 0)
+		throw std::invalid_argument("invalid size distribution: " + description);
+}
+
+std::size_t size_distribution::sample(std::mt19937_64& rng) const
+{
+	switch (m_Kind)
+	{
+	case kind::uniform:
+		return std::uniform_int_distribution<std::size_t>(m_Min, m_Max)(rng);
+	case kind::exponential:
+		return std::clamp(static_cast<std::size_t>(std::exponential_distribution<double>(1.0 / m_Mean)(rng)), m_Min, m_Max);
+	case kind::fixed:
+	default:
+		return m_Min;
+	}
+}
+
+const std::string& size_distribution::description() const
+{
+	return m_Description;
+}
+
+LoadGen::session::session(asio::io_context& context) :
+	timer(context)
+{
+}
+
+LoadGen::LoadGen(const loadgen_config& config) :
+	m_Config(config),
+	m_Pool(config.threads),
+	//room for the closed marker of every connection
+	m_QueueMsgIn(std::max<std::size_t>(64, config.connections * 2))
+{
+}
+
+LoadGen::~LoadGen()
+{
+	//stops the io contexts and joins their threads
+	//then releases the connections while the contexts still exist
+	m_Stop = true;
+	m_Pool.stop();
+	m_Sessions.clear();
+}
+
+bool LoadGen::run()
+{
+	m_Pool.run();
+
+	std::size_t connected = connect();
+	std::cout << "[LOADGEN] " << connected << "/" << m_Config.connections << " connections on "
+		<< m_Pool.size() << " io threads\n";
+	if (connected == 0)
+		return false;
+
+	//every session starts at the same time, the open loop schedules
+	//are spread inside the first interval
+	auto begin = std::chrono::steady_clock::now();
+	for (auto& s : m_Sessions)
+	{
+		if (!s->conn->is_connected())
+			continue;
+		asio::post(s->timer.get_executor(), [this, &s = *s, begin]() { start(s, begin); });
+	}
+
+	std::this_thread::sleep_for(m_Config.duration);
+	m_Stop = true;
+	report(std::chrono::steady_clock::now() - begin);
+
+	return true;
+}
+
+std::size_t LoadGen::connect()
+{
+	asio::ip::tcp::resolver resolver(m_Pool.get_io_context(0));
+	asio::ip::tcp::resolver::results_type endpoints = resolver.resolve(m_Config.host, m_Config.port);
+
+	std::atomic<std::size_t> connected = 0;
+	std::atomic<std::size_t> done = 0;
+
+	m_Sessions.reserve(m_Config.connections);
+	for (std::size_t i = 0; i < m_Config.connections; ++i)
+	{
+		//the connections are spread across the pool
+		asio::io_context& context = m_Pool.get_io_context();
+		session& s = *m_Sessions.emplace_back(std::make_unique<session>(context));
+
+		s.conn = std::make_shared<connection>(connection::owner::client, context, asio::ip::tcp::socket(context), m_QueueMsgIn);
+		s.conn->on_written([this, &s](std::size_t count) { written(s, count); });
+		s.conn->connect_to_server_task(endpoints,
+			[&connected, &done](bool ok)
+			{
+				if (ok) ++connected;
+				++done;
+			});
+	}
+
+	//every connection either connects or fails
+	while (done < m_Config.connections)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	return connected;
+}
+
+void LoadGen::start(session& s, std::chrono::steady_clock::time_point begin)
+{
+	if (m_Config.rate <= 0)
+	{
+		//closed loop, the pipeline is refilled as the messages are written
+		for (std::size_t i = 0; i < m_Config.pipeline; ++i)
+			send(s, std::chrono::steady_clock::now());
+		return;
+	}
+
+	//each connection sends rate / connections messages per second
+	//starting at a random point of the first interval, so the
+	//connections don't send in bursts
+	double perConnection = m_Config.rate / m_Config.connections;
+	s.interval = std::chrono::nanoseconds(static_cast<long long>(1e9 / perConnection));
+
+	thread_local std::mt19937_64 rng(std::random_device{}());
+	s.next = begin + std::chrono::nanoseconds(std::uniform_int_distribution<long long>(0, s.interval.count())(rng));
+	schedule_task(s);
+}
+
+void LoadGen::schedule_task(session& s)
+{
+	s.timer.expires_at(s.next);
+	s.timer.async_wait(
+		[this, &s](const boost::system::error_code& error)
+		{
+			if (error || m_Stop || !s.conn->is_connected())
+				return;
+
+			//if we are late every message that should have been sent
+			//until now is sent with it's intended time
+			auto now = std::chrono::steady_clock::now();
+			while (s.next <= now)
+			{
+				send(s, s.next);
+				s.next += s.interval;
+			}
+
+			schedule_task(s);
+		});
+}
+
+void LoadGen::send(session& s, std::chrono::steady_clock::time_point intended)
+{
+	thread_local std::mt19937_64 rng(std::random_device{}());
+	std::size_t size = m_Config.sizes.sample(rng);
+
+	//the body is text ended by the null terminator, like the client's messages
+	msg m;
+	m.body.assign(size, 'x');
+	m.body.back() = '\0';
+	m.header.size = static_cast<uint32_t>(size);
+
+	s.inFlight.push_back({ intended, sizeof(msg_header) + size });
+	s.conn->send_msg(m);
+}
+
+void LoadGen::written(session& s, std::size_t count)
+{
+	auto now = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < count && !s.inFlight.empty(); ++i)
+	{
+		const session::pending& p = s.inFlight.front();
+		if (!m_Stop)
+		{
+			m_Latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - p.intended).count());
+			m_Messages.inc();
+			m_Bytes.inc(p.bytes);
+		}
+		s.inFlight.pop_front();
+	}
+
+	//closed loop, one new message for each one written
+	if (m_Config.rate <= 0 && !m_Stop)
+		for (std::size_t i = 0; i < count; ++i)
+			send(s, now);
+}
+
+void LoadGen::report(std::chrono::nanoseconds elapsed) const
+{
+	double seconds = elapsed.count() / 1e9;
+	metrics_histogram::snapshot latency = m_Latency.read();
+
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "[LOADGEN] " << (m_Config.rate > 0 ? "open loop" : "closed loop")
+		<< ", sizes " << m_Config.sizes.description() << ", " << seconds << "s\n";
+	std::cout << "  throughput: " << m_Messages.value() / seconds << " msg/s, "
+		<< m_Bytes.value() / seconds / (1024 * 1024) << " MB/s (" << m_Messages.value() << " messages)\n";
+	std::cout << "  latency (us):";
+	for (auto [name, q] : { std::pair{ "p50", 0.5 }, { "p90", 0.9 }, { "p99", 0.99 }, { "p99.9", 0.999 }, { "p99.99", 0.9999 } })
+		std::cout << " " << name << "=" << latency.quantile(q) / 1e3;
+	std::cout << " max=" << latency.max / 1e3 << " mean=" << latency.mean() / 1e3 << "\n";
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <boost/asio.hpp>
+#include "../common/connection.h"
+#include "../common/io_context_pool.h"
+#include "../common/metrics.h"
+
+using namespace boost;
+
+//distribution of the message sizes (body bytes, null terminator included)
+//fixed:N, uniform:MIN:MAX or exp:MEAN (exponential, capped at 1MB)
+class size_distribution
+{
+public:
+    //throws if the description is invalid
+    explicit size_distribution(const std::string& description = "fixed:64");
+
+    std::size_t sample(std::mt19937_64& rng) const;
+
+    const std::string& description() const;
+
+private:
+    enum class kind
+    {
+        fixed, uniform, exponential
+    };
+
+    std::string m_Description;
+    kind m_Kind = kind::fixed;
+    std::size_t m_Min = 64;
+    std::size_t m_Max = 64;
+    double m_Mean = 64;
+};
+
+struct loadgen_config
+{
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    std::size_t connections = 100;
+    //0 uses one io thread per hardware thread
+    std::size_t threads = 0;
+    //total messages per second (open loop), 0 sends as fast as possible
+    double rate = 0;
+    std::chrono::seconds duration{ 10 };
+    //messages in flight per connection when sending as fast as possible
+    std::size_t pipeline = 16;
+    size_distribution sizes;
+};
+
+//load generator
+//opens the connections and sends messages to the broker for a duration,
+//then reports the throughput and the latency percentiles
+//-------
+//the broker doesn't answer, so the latency is measured until the message
+//is written to the socket, which grows when the broker doesn't keep up
+//(the socket buffers fill)
+//with a rate (open loop) every message has an intended send time and the
+//latency is measured from it, not from when it was actually sent, so a stall
+//is charged to all the messages that should have been sent during it
+//(coordinated omission correction)
+//without a rate (closed loop) each connection keeps pipeline messages in
+//flight and the latency is measured from when the message is queued
+class LoadGen {
+public:
+    LoadGen(const loadgen_config& config);
+    LoadGen(const LoadGen&) = delete;
+    ~LoadGen();
+
+    //connects, sends for the duration and prints the report
+    //returns false if no connection could be made
+    bool run();
+
+private:
+    //state of a connection, only used by the connection's context
+    struct session
+    {
+        session(asio::io_context& context);
+
+        std::shared_ptr<connection> conn;
+        asio::steady_timer timer;
+        //messages not written yet, in order
+        struct pending
+        {
+            std::chrono::steady_clock::time_point intended;
+            std::size_t bytes;
+        };
+        std::deque<pending> inFlight;
+        //open loop schedule
+        std::chrono::steady_clock::time_point next;
+        std::chrono::nanoseconds interval{ 0 };
+    };
+
+    //opens all the connections and waits for them
+    std::size_t connect();
+
+    //------------- TASKS ---------------
+    //sends every message due until now and waits for the next one (open loop)
+    void schedule_task(session& s);
+    //------------- TASKS ---------------
+
+    //starts sending on the session (from it's context)
+    void start(session& s, std::chrono::steady_clock::time_point begin);
+
+    //sends a message that should be sent at the intended time
+    void send(session& s, std::chrono::steady_clock::time_point intended);
+
+    //called when the connection wrote count messages
+    void written(session& s, std::size_t count);
+
+    void report(std::chrono::nanoseconds elapsed) const;
+
+    const loadgen_config m_Config;
+
+    //the pool must be declared before the sessions since they use it's contexts
+    io_context_pool m_Pool;
+    //the loadgen doesn't receive messages, only the closed connection markers
+    mpsc_queue<msg_owner> m_QueueMsgIn;
+    std::vector<std::unique_ptr<session>> m_Sessions;
+
+    std::atomic<bool> m_Stop = false;
+    metrics_counter m_Messages;
+    metrics_counter m_Bytes;
+    metrics_histogram m_Latency;
+};
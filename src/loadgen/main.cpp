@@ -0,0 +1,56 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include "LoadGen.h"
+
+static void usage()
+{
+	std::cout << "Usage: loadgen [options]\n"
+		<< "  --host HOST           server host (127.0.0.1)\n"
+		<< "  --port PORT           server port (8080)\n"
+		<< "  --connections N       connections to open (100)\n"
+		<< "  --threads N           io threads, 0 uses one per hardware thread (0)\n"
+		<< "  --rate N              total messages per second, 0 sends as fast as possible (0)\n"
+		<< "  --duration SECONDS    time sending (10)\n"
+		<< "  --pipeline N          messages in flight per connection without a rate (16)\n"
+		<< "  --size DIST           fixed:N, uniform:MIN:MAX or exp:MEAN (fixed:64)\n";
+}
+
+int main(int argc, char* argv[])
+{
+	loadgen_config config;
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string option = argv[i];
+			if (option == "--help")
+			{
+				usage();
+				return 0;
+			}
+			if (i + 1 >= argc)
+				throw std::invalid_argument("missing value of " + option);
+
+			std::string value = argv[++i];
+			if (option == "--host") config.host = value;
+			else if (option == "--port") config.port = value;
+			else if (option == "--connections") config.connections = std::max<std::size_t>(1, std::stoull(value));
+			else if (option == "--threads") config.threads = std::stoull(value);
+			else if (option == "--rate") config.rate = std::stod(value);
+			else if (option == "--duration") config.duration = std::chrono::seconds(std::stoll(value));
+			else if (option == "--pipeline") config.pipeline = std::max<std::size_t>(1, std::stoull(value));
+			else if (option == "--size") config.sizes = size_distribution(value);
+			else throw std::invalid_argument("unknown option " + option);
+		}
+
+		LoadGen loadgen(config);
+		return loadgen.run() ? 0 : 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "[LOADGEN] " << e.what() << "\n";
+		usage();
+		return 1;
+	}
+}
@@ -0,0 +1,228 @@
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "LogQuery.h"
+
+LogQuery::mapping::mapping(const std::filesystem::path& path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	struct stat st;
+	if (::fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			data = static_cast<const std::uint8_t*>(map);
+			size = st.st_size;
+		}
+	}
+	::close(fd);
+}
+
+LogQuery::mapping::~mapping()
+{
+	if (data)
+		::munmap(const_cast<std::uint8_t*>(data), size);
+}
+
+LogQuery::LogQuery(const query_config& config) :
+	m_Config(config)
+{
+}
+
+bool LogQuery::run()
+{
+	namespace fs = std::filesystem;
+
+	//the names start with the creation time
+	std::vector<fs::path> logs;
+	std::error_code error;
+	for (const fs::directory_entry& entry : fs::directory_iterator(m_Config.dir, error))
+		if (entry.is_regular_file(error) && entry.path().extension() == shared_log::extension)
+			logs.push_back(entry.path());
+	if (error)
+		std::cerr << "[QUERY] " << m_Config.dir << ": " << error.message() << "\n";
+	std::sort(logs.begin(), logs.end());
+
+	auto begin = std::chrono::steady_clock::now();
+	std::size_t invalid = 0;
+	for (const fs::path& path : logs)
+		if (!query(path))
+			++invalid;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	if (m_Config.list)
+		for (const auto& [id, summary] : m_Clients)
+			std::cout << id << ' ' << summary.records << ' ' << summary.first << ' ' << summary.last << "\n";
+	else
+		std::cerr << "[QUERY] " << m_Messages << " messages of " << m_Config.client << ", ";
+
+	std::cerr << logs.size() << " logs, " << m_BytesRead / (1024.0 * 1024.0) << " of "
+		<< m_BytesTotal / (1024.0 * 1024.0) << " MB read in " << seconds * 1000 << " ms\n";
+	if (invalid > 0)
+		std::cerr << "[QUERY] " << invalid << " invalid logs\n";
+	return invalid == 0;
+}
+
+bool LogQuery::query(const std::filesystem::path& path)
+{
+	mapping log(path);
+	m_BytesTotal += log.size;
+
+	//just created, nothing written yet
+	if (log.size == 0)
+		return true;
+
+	std::uint64_t created = shared_log::read_header(log.data, log.size, shared_log::magic);
+	if (created == 0)
+	{
+		std::cerr << path.string() << ": " << shared_log::to_string(shared_log::scan_error::header) << "\n";
+		return false;
+	}
+
+	//the client's numbers (or all of them for the list)
+	std::vector<shared_log::index_entry> index = read_index(path, created, log.size);
+	std::map<std::uint32_t, std::string> numbers;
+	std::size_t indexed = sizeof(shared_log::file_header);
+	for (const shared_log::index_entry& entry : index)
+	{
+		indexed = std::max<std::size_t>(indexed, entry.end);
+		if (entry.records != 0)
+			continue;
+		std::string id = declared(log, entry);
+		if (!id.empty() && (m_Config.list || id == m_Config.client))
+			numbers[entry.client] = id;
+	}
+
+	bool valid = true;
+	shared_log::scan_error error;
+	auto visit = [this, &numbers](const shared_log::record_header& header, std::size_t, std::string_view body)
+	{
+		if (header.kind == shared_log::record_kind::client)
+		{
+			if (m_Config.list || body == m_Config.client)
+				numbers[header.client] = body;
+			return;
+		}
+
+		auto it = numbers.find(header.client);
+		if (it == numbers.end() || !in_range(header.timestamp))
+			return;
+		if (m_Config.list)
+		{
+			client_summary& summary = m_Clients[it->second];
+			++summary.records;
+			summary.first = std::min(summary.first, header.timestamp);
+			summary.last = std::max(summary.last, header.timestamp);
+			return;
+		}
+
+		if (m_Config.timestamps)
+			std::cout << header.timestamp << ' ';
+		std::cout << body << "\n";
+		++m_Messages;
+	};
+
+	if (m_Config.list)
+	{
+		//the index has the counts
+		for (const shared_log::index_entry& entry : index)
+		{
+			auto it = numbers.find(entry.client);
+			if (entry.records == 0 || it == numbers.end())
+				continue;
+			client_summary& summary = m_Clients[it->second];
+			summary.records += entry.records;
+			summary.first = std::min(summary.first, entry.first);
+			summary.last = std::max(summary.last, entry.last);
+		}
+	}
+	else
+	{
+		//only the ranges of the client's records in the time range are read,
+		//in the order they were written
+		std::vector<const shared_log::index_entry*> runs;
+		for (const shared_log::index_entry& entry : index)
+			if (entry.records > 0 && numbers.contains(entry.client)
+				&& entry.first <= m_Config.to && entry.last >= m_Config.from)
+				runs.push_back(&entry);
+		std::sort(runs.begin(), runs.end(),
+			[](const shared_log::index_entry* a, const shared_log::index_entry* b) { return a->begin < b->begin; });
+
+		for (const shared_log::index_entry* run : runs)
+		{
+			shared_log::scan(log.data, run->begin, run->end, visit, error);
+			m_BytesRead += run->end - run->begin;
+			if (error != shared_log::scan_error::none)
+			{
+				std::cerr << path.string() << ": " << shared_log::to_string(error) << " in the records at "
+					<< run->begin << "-" << run->end << "\n";
+				valid = false;
+			}
+		}
+	}
+
+	//the records written after the index (the log is being written, or
+	//the server stopped before writing the index)
+	std::size_t end = shared_log::scan(log.data, indexed, log.size, visit, error);
+	m_BytesRead += log.size - indexed;
+	if (error == shared_log::scan_error::checksum)
+	{
+		std::cerr << path.string() << ": " << shared_log::to_string(error) << " at " << end << "\n";
+		valid = false;
+	}
+	else if (error == shared_log::scan_error::torn)
+		std::cerr << path.string() << ": " << shared_log::to_string(error) << " at " << end << ", ignored\n";
+	return valid;
+}
+
+std::vector<shared_log::index_entry> LogQuery::read_index(const std::filesystem::path& path,
+	std::uint64_t created, std::size_t logSize) const
+{
+	std::filesystem::path indexPath = path;
+	indexPath.replace_extension(shared_log::index_extension);
+	mapping index(indexPath);
+
+	//an index of another log is ignored, the log is scanned
+	std::vector<shared_log::index_entry> entries;
+	if (shared_log::read_header(index.data, index.size, shared_log::index_magic) != created)
+		return entries;
+
+	//an incomplete entry at the end is ignored, and the entries pointing
+	//past the log (not written when the server stopped)
+	std::size_t count = (index.size - sizeof(shared_log::file_header)) / sizeof(shared_log::index_entry);
+	entries.reserve(count);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		shared_log::index_entry entry;
+		std::memcpy(&entry, index.data + sizeof(shared_log::file_header) + i * sizeof(entry), sizeof(entry));
+		if (entry.begin >= sizeof(shared_log::file_header) && entry.begin < entry.end && entry.end <= logSize)
+			entries.push_back(entry);
+	}
+	return entries;
+}
+
+std::string LogQuery::declared(const mapping& log, const shared_log::index_entry& entry)
+{
+	std::string id;
+	shared_log::scan_error error;
+	shared_log::scan(log.data, entry.begin, entry.end,
+		[&id](const shared_log::record_header& header, std::size_t, std::string_view body)
+		{
+			if (header.kind == shared_log::record_kind::client)
+				id = body;
+		}, error);
+	return id;
+}
+
+bool LogQuery::in_range(std::uint64_t timestamp) const
+{
+	return timestamp >= m_Config.from && timestamp <= m_Config.to;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <limits>
+#include <filesystem>
+#include "../common/shared_log.h"
+
+struct query_config
+{
+    //directory of the shared logs (the server's output directory)
+    std::string dir;
+    //client whose stream is reconstructed
+    std::string client;
+    //time range of the messages, nanoseconds since the unix epoch (inclusive)
+    std::uint64_t from = 0;
+    std::uint64_t to = std::numeric_limits<std::uint64_t>::max();
+    //lists the clients instead (from the indexes)
+    bool list = false;
+    //prints the timestamp before each message
+    bool timestamps = false;
+};
+
+//reader of the shared logs
+//the logs are taken in the order they were created, a client is only written
+//by one writer at a time so it's stream is in that order
+//in each log the index gives the client's numbers (it's declarations) and the
+//byte ranges of it's records in the time range, only those ranges are read from
+//the mapped log; the tail after the last indexed record is scanned
+class LogQuery {
+public:
+    explicit LogQuery(const query_config& config);
+
+    //prints the client's messages (or the clients), returns false if a log is invalid
+    bool run();
+
+private:
+    //read only mapping of a file, empty if it can't be mapped
+    struct mapping
+    {
+        explicit mapping(const std::filesystem::path& path);
+        mapping(const mapping&) = delete;
+        ~mapping();
+
+        const std::uint8_t* data = nullptr;
+        std::size_t size = 0;
+    };
+
+    //clients seen by the list
+    struct client_summary
+    {
+        std::uint64_t records = 0;
+        std::uint64_t first = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t last = 0;
+    };
+
+    //queries one log, returns false if it's invalid
+    bool query(const std::filesystem::path& path);
+
+    //the valid index entries of a log (empty without index)
+    std::vector<shared_log::index_entry> read_index(const std::filesystem::path& path,
+        std::uint64_t created, std::size_t logSize) const;
+
+    //id of the client declared by an index entry, empty if the record is invalid
+    static std::string declared(const mapping& log, const shared_log::index_entry& entry);
+
+    bool in_range(std::uint64_t timestamp) const;
+
+    query_config m_Config;
+    std::uint64_t m_Messages = 0;
+    std::uint64_t m_BytesRead = 0;
+    std::uint64_t m_BytesTotal = 0;
+    std::map<std::string, client_summary> m_Clients;
+};
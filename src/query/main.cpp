@@ -0,0 +1,67 @@
+#include <iostream>
+#include <string>
+#include "LogQuery.h"
+
+static void usage()
+{
+	std::cout << "Usage: log_query [options] DIR\n"
+		<< "  DIR                   output directory of a server with the shared storage layout\n"
+		<< "  --client ID           client whose messages are printed, in the order they were stored\n"
+		<< "  --from NS             first timestamp, nanoseconds since the unix epoch (0)\n"
+		<< "  --to NS               last timestamp, nanoseconds since the unix epoch (no limit)\n"
+		<< "  --timestamps          prints the timestamp (ns) before each message\n"
+		<< "  --list                lists the clients: id, messages, first and last timestamp\n";
+}
+
+int main(int argc, char* argv[])
+{
+	query_config config;
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string option = argv[i];
+			if (option == "--help")
+			{
+				usage();
+				return 0;
+			}
+			if (option == "--list")
+			{
+				config.list = true;
+				continue;
+			}
+			if (option == "--timestamps")
+			{
+				config.timestamps = true;
+				continue;
+			}
+			if (!option.starts_with("--"))
+			{
+				config.dir = option;
+				continue;
+			}
+			if (i + 1 >= argc)
+				throw std::invalid_argument("missing value of " + option);
+
+			std::string value = argv[++i];
+			if (option == "--client") config.client = value;
+			else if (option == "--from") config.from = std::stoull(value);
+			else if (option == "--to") config.to = std::stoull(value);
+			else throw std::invalid_argument("unknown option " + option);
+		}
+		if (config.dir.empty())
+			throw std::invalid_argument("no directory");
+		if (config.client.empty() && !config.list)
+			throw std::invalid_argument("no client");
+
+		LogQuery query(config);
+		return query.run() ? 0 : 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "[QUERY] " << e.what() << "\n";
+		usage();
+		return 1;
+	}
+}
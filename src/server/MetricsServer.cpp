@@ -0,0 +1,140 @@
+#include <fstream>
+#include <filesystem>
+#include "MetricsServer.h"
+
+//a single scrape, the request is read until the end of the headers
+//answered and the connection is closed
+class scrape : public std::enable_shared_from_this<scrape>
+{
+public:
+	scrape(asio::ip::tcp::socket&& socket, const metrics_registry& registry) :
+		m_Socket(std::move(socket)),
+		m_Registry(registry),
+		//the request is small, bigger ones are refused
+		m_Request(max_request)
+	{
+	}
+
+	void start()
+	{
+		asio::async_read_until(m_Socket, m_Request, "\r\n\r\n",
+			[this, self = this->shared_from_this()](const boost::system::error_code& error, std::size_t)
+			{
+				if (error)
+					return;
+
+				//only the request line matters: "GET /metrics HTTP/1.1"
+				std::istream stream(&m_Request);
+				std::string method, target;
+				stream >> method >> target;
+
+				if (method != "GET")
+					respond("405 Method Not Allowed", "");
+				else if (target != "/metrics" && target != "/")
+					respond("404 Not Found", "");
+				else
+					respond("200 OK", m_Registry.to_prometheus());
+			});
+	}
+
+private:
+	void respond(const std::string& status, const std::string& body)
+	{
+		m_Response = "HTTP/1.1 " + status + "\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: " + std::to_string(body.size()) + "\r\n"
+			"Connection: close\r\n\r\n" + body;
+
+		asio::async_write(m_Socket, asio::buffer(m_Response),
+			[this, self = this->shared_from_this()](const boost::system::error_code&, std::size_t)
+			{
+				boost::system::error_code error;
+				m_Socket.shutdown(asio::ip::tcp::socket::shutdown_both, error);
+				m_Socket.close(error);
+			});
+	}
+
+	static constexpr std::size_t max_request = 8 * 1024;
+
+	asio::ip::tcp::socket m_Socket;
+	const metrics_registry& m_Registry;
+	asio::streambuf m_Request;
+	std::string m_Response;
+};
+
+MetricsServer::MetricsServer(asio::io_context& context, const metrics_registry& registry, unsigned short port,
+	const std::string& dumpFile, std::chrono::milliseconds dumpInterval) :
+	m_Context(context),
+	m_Registry(registry),
+	m_DumpFile(dumpFile),
+	m_DumpInterval(std::max(dumpInterval, std::chrono::milliseconds(1))),
+	m_DumpTimer(context)
+{
+	//only listens on the loopback, the metrics are not meant to be public
+	if (port != 0)
+		m_Acceptor.emplace(m_Context, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), port));
+}
+
+void MetricsServer::start()
+{
+	if (m_Acceptor)
+	{
+		log_info() << "[METRICS] Listening on " << m_Acceptor->local_endpoint();
+		accept_task();
+	}
+
+	if (!m_DumpFile.empty())
+	{
+		m_DumpTimer.expires_after(m_DumpInterval);
+		dump_task();
+	}
+}
+
+void MetricsServer::accept_task()
+{
+	m_Acceptor->async_accept(
+		[this](std::error_code error, asio::ip::tcp::socket socket)
+		{
+			if (!error)
+				std::make_shared<scrape>(std::move(socket), m_Registry)->start();
+			else
+				log_error() << "[METRICS] New Connection Error: " << error.message();
+
+			accept_task();
+		});
+}
+
+void MetricsServer::dump_task()
+{
+	m_DumpTimer.async_wait(
+		[this](const boost::system::error_code& error)
+		{
+			if (error)
+				return;
+
+			dump();
+
+			//scheduled from the last expiry, so the dumps don't drift
+			m_DumpTimer.expires_at(m_DumpTimer.expiry() + m_DumpInterval);
+			dump_task();
+		});
+}
+
+void MetricsServer::dump()
+{
+	std::string tmp = m_DumpFile + ".tmp";
+	{
+		std::ofstream file(tmp, std::ios::trunc);
+		if (!file)
+		{
+			log_error() << "[METRICS] Failed to open " << tmp;
+			return;
+		}
+		file << m_Registry.to_prometheus();
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tmp, m_DumpFile, error);
+	if (error)
+		log_error() << "[METRICS] Failed to write " << m_DumpFile << ": " << error.message();
+}
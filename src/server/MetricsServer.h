@@ -0,0 +1,47 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <optional>
+#include <boost/asio.hpp>
+#include "../common/metrics.h"
+#include "../common/logger.h"
+
+using namespace boost;
+
+//exposes the metrics registry
+//as prometheus text over http on a local port (GET /metrics)
+//and optionally dumped to a file every interval
+//everything runs as tasks of the given context, so it doesn't need threads
+class MetricsServer {
+public:
+    //port 0 disables the http endpoint and an empty file disables the dump
+    MetricsServer(asio::io_context& context, const metrics_registry& registry, unsigned short port,
+        const std::string& dumpFile, std::chrono::milliseconds dumpInterval);
+    MetricsServer(const MetricsServer&) = delete;
+
+    void start();
+
+private:
+    //------------- TASKS ---------------
+    //task to await a new scrape connection
+    void accept_task();
+
+    //task to write the metrics to the dump file every interval
+    void dump_task();
+    //------------- TASKS ---------------
+
+    //writes the metrics to the dump file
+    //it's written to a temporary file and renamed, so readers never see a partial dump
+    void dump();
+
+    asio::io_context& m_Context;
+    const metrics_registry& m_Registry;
+
+    std::optional<asio::ip::tcp::acceptor> m_Acceptor;
+
+    const std::string m_DumpFile;
+    const std::chrono::milliseconds m_DumpInterval;
+    asio::steady_timer m_DumpTimer;
+};
@@ -0,0 +1,107 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../common/logger.h"
+#include "SegmentAllocator.h"
+
+SegmentAllocator::SegmentAllocator(const std::string& outputDir, std::size_t fileSize, std::size_t spares) :
+	m_Dir(std::filesystem::path(outputDir) / "@spare"),
+	m_FileSize(fileSize),
+	m_Spares(spares)
+{
+	//the spares of a previous run are discarded, they are recreated
+	//with the current size
+	std::error_code error;
+	std::filesystem::remove_all(m_Dir, error);
+	std::filesystem::create_directories(m_Dir, error);
+	if (error)
+		log_error() << "[STORAGE] Failed to create " << m_Dir << ": " << error.message();
+
+	m_Thread = std::thread([this]() { filler(); });
+}
+
+SegmentAllocator::~SegmentAllocator()
+{
+	{
+		std::scoped_lock lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_CV.notify_one();
+	if (m_Thread.joinable())
+		m_Thread.join();
+
+	for (spare& s : m_Ready)
+	{
+		::close(s.fd);
+		::unlink(s.path.c_str());
+	}
+	std::error_code error;
+	std::filesystem::remove(m_Dir, error);
+}
+
+int SegmentAllocator::take(const std::filesystem::path& path)
+{
+	spare s;
+	{
+		std::scoped_lock lock(m_Mutex);
+		if (m_Ready.empty())
+			return -1;
+		s = m_Ready.back();
+		m_Ready.pop_back();
+	}
+	m_CV.notify_one();
+
+	//same filesystem, the blocks go with the file
+	if (::rename(s.path.c_str(), path.c_str()) != 0)
+	{
+		log_error() << "[STORAGE] Failed to move " << s.path << " to " << path << ": " << std::strerror(errno);
+		::close(s.fd);
+		::unlink(s.path.c_str());
+		return -1;
+	}
+	return s.fd;
+}
+
+int SegmentAllocator::create(const std::filesystem::path& path, std::size_t size)
+{
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -1;
+
+	//posix_fallocate may emulate it by writing zeros,
+	//fallocate allocates the extents without writing
+	if (::fallocate(fd, 0, 0, size) != 0 && ::ftruncate(fd, size) != 0)
+	{
+		::close(fd);
+		::unlink(path.c_str());
+		return -1;
+	}
+	return fd;
+}
+
+void SegmentAllocator::filler()
+{
+	std::unique_lock lock(m_Mutex);
+	while (true)
+	{
+		m_CV.wait(lock, [this]() { return m_Stop || m_Ready.size() < m_Spares; });
+		if (m_Stop)
+			return;
+
+		std::filesystem::path path = m_Dir / ("spare_" + std::to_string(m_Counter++));
+		lock.unlock();
+		int fd = create(path, m_FileSize);
+		lock.lock();
+
+		if (fd < 0)
+		{
+			//no space or no permission, the rotations create the segments
+			//themselves, tries again later
+			log_error() << "[STORAGE] Failed to preallocate " << path << ": " << std::strerror(errno);
+			m_CV.wait_for(lock, std::chrono::seconds(1), [this]() { return m_Stop; });
+			continue;
+		}
+		m_Ready.push_back({ path, fd });
+	}
+}
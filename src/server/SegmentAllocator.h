@@ -0,0 +1,50 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+
+//keeps preallocated segment files ready for the rotations
+//a background thread creates the files in a spare directory of the output
+//directory and allocates their blocks (fallocate) up to the segment size, so
+//a rotation only renames one into the client's directory instead of creating
+//the inode and allocating the extents while the messages wait
+//the spare directory ('@spare') can't clash with a client, '@' isn't valid in ids
+class SegmentAllocator {
+public:
+    SegmentAllocator(const std::string& outputDir, std::size_t fileSize, std::size_t spares);
+    SegmentAllocator(const SegmentAllocator&) = delete;
+    //the spare files left are removed
+    ~SegmentAllocator();
+
+    //moves a spare file to path and returns it's fd (open for read and write)
+    //-1 if none is ready, the caller creates the segment itself
+    int take(const std::filesystem::path& path);
+
+    //creates a segment file of size bytes (blocks allocated), -1 on failure
+    static int create(const std::filesystem::path& path, std::size_t size);
+
+private:
+    struct spare
+    {
+        std::filesystem::path path;
+        int fd;
+    };
+
+    //background thread, refills the spares when one is taken
+    void filler();
+
+    const std::filesystem::path m_Dir;
+    const std::size_t m_FileSize;
+    const std::size_t m_Spares;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_CV;
+    std::vector<spare> m_Ready;
+    std::size_t m_Counter = 0;
+    bool m_Stop = false;
+    std::thread m_Thread;
+};
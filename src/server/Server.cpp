@@ -1,77 +1,130 @@
 #include <chrono>
 #include <string>
-#include <sstream>
-#include <fstream>
-#include <filesystem>
-#include <chrono>
-#include <ctime>
-#include <set>
+#include <bit>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
 #include <boost/uuid/uuid_io.hpp>
 #include "Server.h"
 
+//the timeout is configured in minutes ("timeout")
+//or with a finer resolution in milliseconds ("timeout_ms"), which has priority
+static std::chrono::milliseconds read_timeout(const property_tree::ptree& config)
+{
+	if (auto ms = config.get_optional<long long>("timeout_ms"))
+		return std::chrono::milliseconds(*ms);
+	return std::chrono::minutes(config.get<int>("timeout"));
+}
+
+//the logger is shared by the whole process
+static void configure_logger(const property_tree::ptree& config)
+{
+	logger::instance().set_level(log_level_from_string(config.get<std::string>("log_level", "info")));
+	logger::instance().set_rate_limit(config.get<std::size_t>("log_rate_limit", 0));
+}
+
+//the durability mode is optional, by default nothing is synced
+//like the old behavior
+static storage_config read_storage_config(const property_tree::ptree& config)
+{
+	storage_config storage;
+	storage.outputDir = config.get<std::string>("output_dir");
+	storage.filePrefix = config.get<std::string>("file_prefix");
+	storage.fileSize = config.get<std::size_t>("file_size");
+	storage.mode = durability_from_string(config.get<std::string>("durability", "none"));
+	storage.syncInterval = std::chrono::milliseconds(config.get<long long>("fsync_interval_ms", 1000));
+	storage.syncMessages = std::max<std::size_t>(1, config.get<std::size_t>("fsync_every_messages", 1000));
+	storage.maxDetached = config.get<std::size_t>("max_detached_segments", 1024);
+	storage.format = segment_format_from_string(config.get<std::string>("segment_format", "text"));
+	storage.layout = storage_layout_from_string(config.get<std::string>("storage_layout", "per_client"));
+	storage.preallocate = config.get<bool>("segment_preallocate", false);
+	storage.spareSegments = config.get<std::size_t>("preallocated_segments", 4);
+	storage.backend = storage_backend_from_string(config.get<std::string>("storage_backend", "posix"));
+	storage.uringEntries = config.get<unsigned>("storage_uring_entries", 256);
+	return storage;
+}
+
 Server::Server(const property_tree::ptree& config) :
 	//config cache
 	m_Config(config),
-	m_Timeout(m_Config.get<int>("timeout")),
-	m_FileSize(m_Config.get<int>("file_size")),
-	m_OutputDir(m_Config.get<std::string>("output_dir")),
-	m_FilePrefix(m_Config.get<std::string>("file_prefix")),
+	m_Timeout(read_timeout(m_Config)),
+	m_StorageConfig(read_storage_config(m_Config)),
+	m_ReusePort(m_Config.get<bool>("reuse_port", false)),
+	m_MaxWriteBytes(m_Config.get<std::size_t>("write_coalesce_bytes", 64 * 1024)),
+	m_LogMessages(m_Config.get<bool>("log_messages", true)),
+
+	//metrics, exposed in the order they are registered
+	m_Accepted(m_Metrics.counter("broker_connections_accepted_total", "Accepted client connections")),
+	m_OnMsgTime(m_Metrics.histogram("broker_on_msg_seconds", "Time spent in the message handler")),
+	m_ConnectionMetrics{
+		m_Metrics.counter("broker_connections_closed_total", "Closed client connections"),
+		m_Metrics.counter("broker_messages_in_total", "Received messages"),
+		m_Metrics.counter("broker_bytes_in_total", "Received bytes, headers included") },
+	m_StorageMetrics{
+		m_Metrics.histogram("broker_storage_write_seconds", "Latency of the segment writes"),
+		m_Metrics.histogram("broker_storage_sync_seconds", "Latency of the segment syncs") },
+	m_StageMetrics{
+		m_Metrics.histogram("broker_stage_receive_seconds", "Time from the header read to the body complete"),
+		m_Metrics.histogram("broker_stage_queue_seconds", "Time from the ingest queue push to the dequeue by the dispatcher"),
+		m_Metrics.histogram("broker_stage_storage_seconds", "Time from the dequeue to the write complete, on_msg included"),
+		m_Metrics.histogram("broker_stage_total_seconds", "Time from the header read to the write complete") },
 
-	m_Acceptor(m_Context, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), config.get<int>("port")))
+	//0 (the default) means one io thread per hardware thread
+	m_Pool(m_Config.get<std::size_t>("io_threads", 0)),
+	m_Wheel(m_Pool.get_io_context(0), m_Timeout, std::chrono::milliseconds(m_Config.get<long long>("timeout_resolution_ms", 1000))),
+	m_Connections(m_Pool.size()),
+	m_QueueMsgIn(m_Config.get<std::size_t>("ingest_queue_capacity", 65536)),
+	//port 0 (the default) disables the endpoint, no file disables the dump
+	m_MetricsServer(m_Pool.get_io_context(0), m_Metrics, m_Config.get<unsigned short>("metrics_port", 0),
+		m_Config.get<std::string>("metrics_dump_file", ""), std::chrono::milliseconds(m_Config.get<long long>("metrics_dump_interval_ms", 10000))),
+	m_Storage(m_StorageConfig, m_Config.get<std::size_t>("storage_writers", 1), &m_StorageMetrics, &m_StageMetrics)
 {
+	configure_logger(m_Config);
+
+	open_rings();
+	//read only when the metrics are exposed
+	m_Metrics.gauge("broker_ingest_queue_depth", "Messages waiting in the ingest queue",
+		[this]() { return static_cast<double>(m_QueueMsgIn.size()); });
+
+	open_acceptors();
 	start();
 }
 
 Server::~Server()
 {
-	//joins both threads
-	m_Context.stop();
-	if (m_RunThread.joinable()) m_RunThread.join();
+	//stops the io contexts and joins their threads
+	m_Pool.stop();
 
-	m_StopConnectionThread = true;
-	if (m_CheckConnectionsThread.joinable()) m_CheckConnectionsThread.join();
+	//releases the connections while the contexts still exist
+	m_Connections.clear();
 
-	std::cout << "[SERVER] Stopped\n";
+	log_info() << "[SERVER] Stopped";
 }
 
 void Server::start()
 {
 	try
 	{
-		//gives a task to the context before running so it doesn't die
-		client_connection_task();
-		//create the thread for the server context to run
-		m_RunThread = std::thread([this]() { m_Context.run(); });
-		//thread used to clean the closed connections
-		m_CheckConnectionsThread = std::thread(
-			[this]() 
-			{ 
-				//the atomic variable m_StopConnectionThread controls the loop life
-				//during the server execution this thread should not die
-				//it should only be joined at the destructor
-				while (!m_StopConnectionThread)
-				{
-					//waits util m_Connections have at least one entry
-					m_Connections.wait();
-					//removes the closed connections
-					m_Connections.remove_if(
-						[](const std::shared_ptr<connection>& c) {
-							return !c->is_connected();
-						}
-					);
-					//sleep so the thread doesn't consume all the resources
-					std::this_thread::sleep_for(std::chrono::seconds(10));
-				}
-			}
-		);
+		//starts checking the idle connections
+		m_Wheel.start();
+		m_MetricsServer.start();
+		//the rings wait for their completions in their contexts
+		for (std::size_t i = 0; i < m_Rings.size(); ++i)
+			m_Rings[i]->start(m_Pool.get_io_context(i));
+		//gives each acceptor it's accept task before running
+		for (std::size_t i = 0; i < m_Acceptors.size(); ++i)
+			client_connection_task(i);
+		//create the io threads, one for each context in the pool
+		m_Pool.run();
 	}
 	catch (const std::exception& e)
 	{
-		std::cerr << "[SERVER] Exception at start: " << e.what() << "\n";
+		log_error() << "[SERVER] Exception at start: " << e.what();
 		return;
 	}
 
-	std::cout << "[SERVER] Started\n";
+	log_info() << "[SERVER] Started with " << m_Pool.size() << " io threads ("
+		<< (m_Rings.empty() ? "epoll" : "io_uring") << ") and " << m_Storage.size() << " storage writers";
 }
 
 void Server::run()
@@ -79,94 +132,142 @@ void Server::run()
 	//waits util m_QueueMsgIn have at least one message
 	m_QueueMsgIn.wait();
 
-	//proccess all the messages
-	while (!m_QueueMsgIn.empty())
+	//proccess all the messages in batches
+	//each message is passed to the handler function and then the whole
+	//batch goes to the storage, so the handoff is made once per batch
+	while (m_QueueMsgIn.drain_into(m_Batch, max_batch) > 0)
 	{
-		//remove the front message and pass it to the handler function
-		msg_owner msg = m_QueueMsgIn.pop_front();
-		on_msg(msg);
+		//the whole batch was taken at once
+		std::uint64_t dequeue = msg_trace::now();
+		for (msg_owner& msg : m_Batch)
+			msg.trace.dequeue = dequeue;
+
+		for (const msg_owner& msg : m_Batch)
+		{
+			auto begin = std::chrono::steady_clock::now();
+			on_msg(msg);
+			m_OnMsgTime.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+		}
+
+		m_Storage.push(m_Batch);
 	}
 }
 
-void Server::client_connection_task()
+std::shared_ptr<connection> Server::find_connection(const uuids::uuid& id) const
 {
-	m_Acceptor.async_accept(
-		[this](std::error_code error, asio::ip::tcp::socket socket) 
+	return m_Connections.find(id);
+}
+
+void Server::open_rings()
+{
+	std::string backend = m_Config.get<std::string>("network_backend", "epoll");
+	if (backend == "epoll")
+		return;
+	if (backend != "io_uring")
+		throw std::invalid_argument("invalid network backend: " + backend);
+
+	if (!uring::supported())
+	{
+		log_warn() << "[SERVER] io_uring isn't supported, using epoll";
+		return;
+	}
+
+	uring::options options;
+	options.entries = m_Config.get<unsigned>("uring_entries", 1024);
+	options.buffers = std::bit_ceil(m_Config.get<unsigned>("uring_buffers", 1024));
+	options.bufferSize = m_Config.get<std::size_t>("uring_buffer_size", 16 * 1024);
+
+	try
+	{
+		for (std::size_t i = 0; i < m_Pool.size(); ++i)
+			m_Rings.push_back(std::make_unique<uring>(options));
+	}
+	catch (const std::system_error& e)
+	{
+		//the kernel has io_uring but not the multishot receives
+		if (e.code().value() == EINVAL)
+			log_warn() << "[SERVER] io_uring multishot receives aren't supported (linux 6.0+), using epoll";
+		else
+			log_warn() << "[SERVER] Failed to create the io_uring rings (" << e.what() << "), using epoll";
+		m_Rings.clear();
+	}
+	catch (const std::exception& e)
+	{
+		log_warn() << "[SERVER] Failed to create the io_uring rings (" << e.what() << "), using epoll";
+		m_Rings.clear();
+	}
+}
+
+void Server::open_acceptors()
+{
+	asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), m_Config.get<int>("port"));
+
+	if (!m_ReusePort)
+	{
+		m_Acceptors.emplace_back(m_Pool.get_io_context(0), endpoint);
+		return;
+	}
+
+	//SO_REUSEPORT isn't exposed by asio so we declare the option ourselves
+	using reuse_port = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+	m_Acceptors.reserve(m_Pool.size());
+	for (std::size_t i = 0; i < m_Pool.size(); ++i)
+	{
+		asio::ip::tcp::acceptor& acceptor = m_Acceptors.emplace_back(m_Pool.get_io_context(i));
+		acceptor.open(endpoint.protocol());
+		acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+		acceptor.set_option(reuse_port(true));
+		acceptor.bind(endpoint);
+		acceptor.listen();
+	}
+}
+
+void Server::client_connection_task(std::size_t i)
+{
+	//with one acceptor per context the connection stays on the context
+	//(and core) that accepted it, with a single acceptor the accepted
+	//sockets are spread across the pool
+	//either way the connection never leaves it's context so it's handlers
+	//are never run concurrently
+	std::size_t index = m_ReusePort ? i : m_Pool.next_index();
+	asio::io_context& context = m_Pool.get_io_context(index);
+	m_Acceptors[i].async_accept(context,
+		[this, i, index, &context](std::error_code error, asio::ip::tcp::socket socket) 
 		{
 			if (!error) 
 			{
-				std::cout << "[SERVER] Connection: " << socket.remote_endpoint() << "\n";
-				//adds the connection to the vector
-				m_Connections.emplace_back(std::make_shared<connection>(connection::owner::server, m_Context, std::move(socket), m_QueueMsgIn, m_Timeout));
+				log_info() << "[SERVER] Connection: " << socket.remote_endpoint();
+				m_Accepted.inc();
+				//adds the connection to the registry, it removes itself when closed
+				auto conn = std::make_shared<connection>(connection::owner::server, context, std::move(socket), m_QueueMsgIn, &m_Wheel, m_MaxWriteBytes, &m_ConnectionMetrics,
+					m_Rings.empty() ? nullptr : m_Rings[index].get());
+				m_Connections.add(conn);
 				//give it the task to wait the client's message
-				m_Connections.back()->wait_to_client_msg_task();
+				//it's posted to the connection's context so the
+				//timer and the reads are started from it's own thread
+				asio::post(context, [conn]() { conn->wait_to_client_msg_task(); });
 			}
 			else
 			{
-				std::cerr << "[SERVER] New Connection Error: " << error.message() << "\n";
+				log_error() << "[SERVER] New Connection Error: " << error.message();
 			}
 
-			//after we give the context a new task so it doesn't die
-			client_connection_task();
+			//after we give the acceptor a new task to keep accepting
+			client_connection_task(i);
 		});
 }
 
 void Server::on_msg(const msg_owner& msgIn)
 {
-	//get the sent message
-	std::string userMsg = msgIn.message.get();
-	//get the client id
-	std::string id = uuids::to_string(msgIn.owner->uuid());
-	
-	//current timestamp to string
-	auto now = std::chrono::system_clock::now();
-	auto tt = std::chrono::system_clock::to_time_t(now);
-	auto localTime = std::localtime(&tt);
-
-	std::stringstream ss;
-	ss << localTime->tm_year + 1900 
-	<< localTime->tm_mon + 1 
-	<< localTime->tm_mday
-	<< localTime->tm_hour
-	<< localTime->tm_min
-	<< localTime->tm_sec;
-	std::string time = ss.str();
-
-	//this set is used to order the files inside the directory so we get
-	//the last one created
-	std::set<std::filesystem::path> files;
-
-	//base path
-	std::filesystem::path path = m_OutputDir + "/" + id;
-	//creates the base path for safety
-	std::filesystem::create_directory(path);
-	//iterator for the directory
-	std::filesystem::directory_iterator directory(path);
-	//append the file info to the path
-	path += "/" + m_FilePrefix + "_" + time + ".txt";
-
-	//goes through each entry in the directory
-	for (const auto& entry : directory)
-	{
-		//checks if it's a file and 
-		//if the current size + message size will not exceed the max size
-		if (!entry.is_regular_file()) continue;
-		if (entry.file_size() + userMsg.size() > m_FileSize) continue;
-		//inserts in the set
-		files.insert(entry);
-	}
-	
-	//if anything was added to the set it means that they are
-	//valid files, so we get the last one created
-	//if none is added we are going to use the file name created earlier
-	if (files.size() > 0)
-		path = *(--files.end());
-
-	//opens the file writes to it and close it
-	std::ofstream file(path, std::ios::app);
-	file << userMsg << "\n";
-	file.close();
-
-	//log the sent message to the console
-	std::cout << "[" << id << "] New message: " << userMsg << "\n";
+	//an empty message means the connection was closed
+	//it goes to the storage after the client's last message
+	//so the client's active segment can be closed
+	if (msgIn.message.empty())
+		return;
+
+	//log the sent message to the console (if enabled)
+	//the message is a view of the received buffer, no copy is made
+	if (m_LogMessages)
+		log_info() << "[" << msgIn.owner->uuid_string() << "] New message: " << msgIn.message.view();
 }
@@ -4,10 +4,20 @@
 #include <thread>
 #include <atomic>
 #include <deque>
+#include <vector>
+#include <chrono>
 #include <boost/asio.hpp>
 #include <boost/property_tree/ptree.hpp>
-#include "../common/ts_vector.h"
 #include "../common/connection.h"
+#include "../common/io_context_pool.h"
+#include "../common/timing_wheel.h"
+#include "../common/mpsc_queue.h"
+#include "../common/connection_registry.h"
+#include "../common/metrics.h"
+#include "../common/logger.h"
+#include "../common/uring.h"
+#include "StoragePool.h"
+#include "MetricsServer.h"
 
 using namespace boost;
 
@@ -17,32 +27,68 @@ public:
     ~Server();
 
     void run();
+
+    //finds a live connection by it's uuid (from any thread)
+    //returns null if the client is not connected
+    std::shared_ptr<connection> find_connection(const uuids::uuid& id) const;
 private:
     void start();
     
     //------------- TASKS ---------------
-    //task to await a new client connection
-    void client_connection_task();
+    //task to await a new client connection on the acceptor i
+    void client_connection_task(std::size_t i);
     //------------- TASKS ---------------
 
+    //creates the rings if the network backend is io_uring
+    void open_rings();
+
+    //creates the listening acceptors
+    //with reuse_port we open one acceptor per io context and let the
+    //kernel load balance the new connections between them
+    void open_acceptors();
+
     //messages handler function
+    //called for each message of the batch before it goes to the storage
     void on_msg(const msg_owner& msgIn);
 
+    //configuration
+    //declared first so it's initialized before everything that uses it
+    const property_tree::ptree& m_Config;
+    const std::chrono::milliseconds m_Timeout;
+    const storage_config m_StorageConfig;
+    const bool m_ReusePort;
+    const std::size_t m_MaxWriteBytes;
+    //echo every message to the log
+    const bool m_LogMessages;
+
+    //metrics
+    //declared before everything that updates them
+    metrics_registry m_Metrics;
+    metrics_counter& m_Accepted;
+    metrics_histogram& m_OnMsgTime;
+    const connection_metrics m_ConnectionMetrics;
+    const storage_metrics m_StorageMetrics;
+    const stage_metrics m_StageMetrics;
+
     //asio
-    asio::io_context m_Context;
-    asio::ip::tcp::acceptor m_Acceptor;
-    ts_vector<std::shared_ptr<connection>> m_Connections;
-    ts_queue<msg_owner> m_QueueMsgIn;
+    //the pool must be declared before the acceptors and the connections
+    //since they use the contexts owned by it
+    io_context_pool m_Pool;
+    //one ring per context with the io_uring backend, empty with epoll (asio)
+    //declared after the pool since the connections are released with them
+    std::vector<std::unique_ptr<uring>> m_Rings;
+    std::vector<asio::ip::tcp::acceptor> m_Acceptors;
+    timing_wheel m_Wheel;
+    connection_registry m_Connections;
+    //shared by all the connections (producers), consumed by run
+    mpsc_queue<msg_owner> m_QueueMsgIn;
+    //scrape endpoint and dump of the metrics, runs on the first context
+    MetricsServer m_MetricsServer;
 
-    //threads
-    std::thread m_RunThread;
-    std::thread m_CheckConnectionsThread;
-    std::atomic<bool> m_StopConnectionThread;
+    //messages taken from m_QueueMsgIn at once by run
+    static constexpr std::size_t max_batch = 1024;
+    std::vector<msg_owner> m_Batch;
 
-    //configuration
-    const property_tree::ptree& m_Config;
-    const int m_Timeout;
-    const int m_FileSize;
-    const std::string m_OutputDir;
-    const std::string m_FilePrefix;
+    //persistence
+    StoragePool m_Storage;
 };
@@ -0,0 +1,200 @@
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../common/binary_segment.h"
+#include "../common/logger.h"
+#include "Storage.h"
+#include "SharedLog.h"
+
+//write that handles partial writes and interruptions
+static bool write_all(int fd, const char* data, std::size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t written = ::write(fd, data, size);
+		if (written < 0)
+		{
+			if (errno == EINTR) continue;
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+SharedLog::SharedLog(const storage_config& config, const storage_metrics* metrics) :
+	m_Config(config),
+	m_Metrics(metrics)
+{
+}
+
+SharedLog::~SharedLog()
+{
+	close();
+}
+
+void SharedLog::write(const std::string& id, std::string_view message)
+{
+	std::size_t size = sizeof(shared_log::record_header) + message.size();
+
+	//first message or the message doesn't fit in the log
+	//a log with only it's header always takes the message
+	if (m_Fd < 0 || (m_Size > sizeof(shared_log::file_header) && m_Size + size > m_Config.fileSize))
+		rotate();
+	if (m_Fd < 0)
+		return;
+
+	std::uint64_t timestamp = binary_segment::now();
+	auto [it, created] = m_Clients.try_emplace(id);
+	client& c = it->second;
+	if (created)
+	{
+		//the declaration is indexed on it's own, the queries find
+		//the client's number without reading the log
+		c.number = m_NextNumber++;
+		shared_log::index_entry declaration{ c.number, 0, m_Size, m_Size + sizeof(shared_log::record_header) + id.size(), timestamp, timestamp };
+		shared_log::append_record(m_Pending, shared_log::record_kind::client, c.number, timestamp, id);
+		m_PendingIndex.append(reinterpret_cast<const char*>(&declaration), sizeof(declaration));
+		m_Size = declaration.end;
+	}
+
+	if (c.run.records == 0)
+	{
+		c.run.client = c.number;
+		c.run.begin = m_Size;
+		c.run.first = timestamp;
+		m_Runs.push_back(&c);
+	}
+	shared_log::append_record(m_Pending, shared_log::record_kind::message, c.number, timestamp, message);
+	m_Size += size;
+	++c.run.records;
+	c.run.end = m_Size;
+	c.run.last = timestamp;
+}
+
+void SharedLog::forget(const std::string& id)
+{
+	auto it = m_Clients.find(id);
+	if (it == m_Clients.end())
+		return;
+
+	//it's records of the batch are still indexed
+	if (it->second.run.records > 0)
+	{
+		end_run(it->second);
+		std::erase(m_Runs, &it->second);
+	}
+	m_Clients.erase(it);
+}
+
+void SharedLog::flush()
+{
+	if (m_Pending.empty())
+		return;
+
+	auto begin = std::chrono::steady_clock::now();
+	if (!write_all(m_Fd, m_Pending.data(), m_Pending.size()))
+		log_error() << "[STORAGE] Failed to write " << m_Path << ": " << std::strerror(errno);
+	if (m_Metrics)
+		m_Metrics->write.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+	m_Pending.clear();
+	m_Unsynced = true;
+
+	//the index follows the records it points to
+	for (client* c : m_Runs)
+		end_run(*c);
+	m_Runs.clear();
+	if (!write_all(m_IndexFd, m_PendingIndex.data(), m_PendingIndex.size()))
+		log_error() << "[STORAGE] Failed to write the index of " << m_Path << ": " << std::strerror(errno);
+	m_PendingIndex.clear();
+}
+
+void SharedLog::sync()
+{
+	flush();
+	if (!m_Unsynced)
+		return;
+
+	auto begin = std::chrono::steady_clock::now();
+	if (::fdatasync(m_Fd) != 0)
+		log_error() << "[STORAGE] Failed to sync " << m_Path << ": " << std::strerror(errno);
+	if (m_Metrics)
+		m_Metrics->sync.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+	m_Unsynced = false;
+}
+
+bool SharedLog::unsynced() const
+{
+	return m_Unsynced || !m_Pending.empty();
+}
+
+void SharedLog::end_run(client& c)
+{
+	m_PendingIndex.append(reinterpret_cast<const char*>(&c.run), sizeof(c.run));
+	c.run = {};
+}
+
+void SharedLog::rotate()
+{
+	close();
+
+	//the creation time orders the logs, the writer tells apart the logs
+	//created at the same time
+	std::uint64_t created = binary_segment::now();
+	std::ostringstream name;
+	name << m_Config.filePrefix << '_' << std::setw(20) << std::setfill('0') << created << '_' << m_Config.writer;
+	m_Path = std::filesystem::path(m_Config.outputDir) / name.str();
+	m_Path += shared_log::extension;
+	std::filesystem::path indexPath = m_Path;
+	indexPath.replace_extension(shared_log::index_extension);
+
+	std::error_code error;
+	std::filesystem::create_directories(m_Config.outputDir, error);
+	m_Fd = ::open(m_Path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	m_IndexFd = m_Fd < 0 ? -1 : ::open(indexPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (m_IndexFd < 0)
+	{
+		log_error() << "[STORAGE] Failed to open " << m_Path << ": " << std::strerror(errno);
+		if (m_Fd >= 0)
+			::close(m_Fd);
+		m_Fd = -1;
+		return;
+	}
+
+	//the headers are written with the files, the index's first
+	//so a log always has one
+	std::string header;
+	shared_log::append_header(header, shared_log::index_magic, created);
+	if (!write_all(m_IndexFd, header.data(), header.size()))
+		log_error() << "[STORAGE] Failed to write the index of " << m_Path << ": " << std::strerror(errno);
+	shared_log::append_header(m_Pending, shared_log::magic, created);
+	m_Size = m_Pending.size();
+}
+
+void SharedLog::close()
+{
+	if (m_Fd < 0)
+		return;
+
+	flush();
+	if (m_Unsynced && m_Config.mode != durability::none)
+	{
+		//the index is complete once the log is closed
+		if (::fdatasync(m_Fd) != 0 || ::fdatasync(m_IndexFd) != 0)
+			log_error() << "[STORAGE] Failed to sync " << m_Path << ": " << std::strerror(errno);
+	}
+	m_Unsynced = false;
+
+	::close(m_Fd);
+	::close(m_IndexFd);
+	m_Fd = m_IndexFd = -1;
+
+	//the numbers are per log
+	m_Clients.clear();
+	m_NextNumber = 0;
+}
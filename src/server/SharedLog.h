@@ -0,0 +1,77 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include "../common/shared_log.h"
+
+struct storage_config;
+struct storage_metrics;
+
+//the log shared by the clients of a storage writer (see shared_log.h)
+//the records are buffered and written with a single sequential write per batch,
+//followed by the index entries of the batch: one per client that wrote in it
+//the log rotates when it's full, a client written to the new log is declared again
+//the logs are never reopened, a restart starts new ones
+class SharedLog {
+public:
+    SharedLog(const storage_config& config, const storage_metrics* metrics);
+    SharedLog(const SharedLog&) = delete;
+    //writes, syncs (if the durability mode requires it) and closes the log
+    ~SharedLog();
+
+    //appends the message to the log (buffered)
+    void write(const std::string& id, std::string_view message);
+
+    //the client is gone, it's number isn't kept
+    //a reconnection gets a new one in the same log
+    void forget(const std::string& id);
+
+    //writes the buffered records and their index entries
+    void flush();
+
+    //flushes and syncs the log
+    void sync();
+
+    //written and not synced
+    bool unsynced() const;
+
+private:
+    struct client
+    {
+        std::uint32_t number = 0;
+        //records of the client in the current batch (records is 0 if none)
+        shared_log::index_entry run{};
+    };
+
+    //closes the current log (if open) and creates a new one
+    void rotate();
+
+    //flushes, syncs (if the durability mode requires it) and closes the log
+    void close();
+
+    //adds the client's run to the index of the batch
+    void end_run(client& c);
+
+    const storage_config& m_Config;
+    const storage_metrics* m_Metrics;
+
+    int m_Fd = -1;
+    int m_IndexFd = -1;
+    std::filesystem::path m_Path;
+    //size of the log with the buffered records
+    std::size_t m_Size = 0;
+
+    //records and index entries not written yet
+    std::string m_Pending;
+    std::string m_PendingIndex;
+    bool m_Unsynced = false;
+
+    //client id -> number in the current log
+    std::unordered_map<std::string, client> m_Clients;
+    //clients with a run in the current batch
+    std::vector<client*> m_Runs;
+    std::uint32_t m_NextNumber = 0;
+};
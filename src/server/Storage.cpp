@@ -0,0 +1,641 @@
+#include <chrono>
+#include <ctime>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../common/binary_segment.h"
+#include "Storage.h"
+
+durability durability_from_string(const std::string& mode)
+{
+	if (mode == "none") return durability::none;
+	if (mode == "interval") return durability::interval;
+	if (mode == "count") return durability::count;
+	if (mode == "batch") return durability::batch;
+	throw std::invalid_argument("invalid durability mode: " + mode);
+}
+
+storage_backend storage_backend_from_string(const std::string& backend)
+{
+	if (backend == "posix") return storage_backend::posix;
+	if (backend == "io_uring") return storage_backend::io_uring;
+	throw std::invalid_argument("invalid storage backend: " + backend);
+}
+
+segment_format segment_format_from_string(const std::string& format)
+{
+	if (format == "text") return segment_format::text;
+	if (format == "binary") return segment_format::binary;
+	throw std::invalid_argument("invalid segment format: " + format);
+}
+
+storage_layout storage_layout_from_string(const std::string& layout)
+{
+	if (layout == "per_client") return storage_layout::per_client;
+	if (layout == "shared") return storage_layout::shared;
+	throw std::invalid_argument("invalid storage layout: " + layout);
+}
+
+//write that handles partial writes and interruptions
+static bool write_all(int fd, const char* data, std::size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t written = ::write(fd, data, size);
+		if (written < 0)
+		{
+			if (errno == EINTR) continue;
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+//nanoseconds since begin
+static std::uint64_t elapsed_ns(std::chrono::steady_clock::time_point begin)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+}
+
+Storage::Storage(const storage_config& config, const storage_metrics* metrics, SegmentAllocator* allocator) :
+	m_Config(config),
+	m_Metrics(metrics),
+	m_Allocator(allocator)
+{
+	if (m_Config.layout == storage_layout::shared)
+	{
+		if (m_Config.preallocate || m_Config.backend == storage_backend::io_uring)
+			log_warn() << "[STORAGE] The shared logs are written with posix writes, without preallocation";
+		m_Log = std::make_unique<SharedLog>(m_Config, m_Metrics);
+		return;
+	}
+
+	if (m_Config.backend != storage_backend::io_uring)
+		return;
+
+	//the mapped segments aren't written, there is nothing to queue
+	if (m_Config.preallocate)
+	{
+		log_warn() << "[STORAGE] The preallocated segments are mapped, the io_uring backend isn't used";
+		return;
+	}
+
+	if (!uring::supported())
+	{
+		log_warn() << "[STORAGE] io_uring isn't supported, using posix writes";
+		return;
+	}
+
+	try
+	{
+		m_Ring = std::make_unique<UringWriter>(m_Config.uringEntries, m_Metrics);
+	}
+	catch (const std::exception& e)
+	{
+		log_warn() << "[STORAGE] Failed to create the io_uring (" << e.what() << "), using posix writes";
+	}
+}
+
+Storage::~Storage()
+{
+	for (auto& [id, seg] : m_Segments)
+		close_segment(seg);
+}
+
+void Storage::write(const std::string& id, std::string_view message)
+{
+	if (m_Log)
+	{
+		m_Log->write(id, message);
+		if (m_Config.mode == durability::count && ++m_UnsyncedMessages >= m_Config.syncMessages)
+			sync();
+		return;
+	}
+
+	//the line written is the message + new line
+	//or the record is the header + message
+	bool binary = m_Config.format == segment_format::binary;
+	std::size_t size = binary ? sizeof(binary_segment::record_header) + message.size() : message.size() + 1;
+	//a binary segment without records still has it's file header
+	std::size_t header = binary ? sizeof(binary_segment::file_header) : 0;
+
+	//first message of the client or the message doesn't fit in the active segment
+	//an empty segment always takes the message, even if it's bigger than the max size
+	segment& seg = m_Segments[id];
+	if (seg.fd < 0)
+		open(id, seg);
+	else if (seg.size > header && seg.size + size > m_Config.fileSize)
+		rotate(id, seg);
+
+	//the client reconnected
+	if (seg.detached)
+	{
+		m_Detached.erase(seg.detachedAt);
+		seg.detached = false;
+	}
+
+	//the segment couldn't be opened, the message is lost
+	if (seg.fd < 0)
+		return;
+	if (m_Ring && !seg.file)
+		seg.file = m_Ring->open(seg.fd);
+
+	if (seg.map)
+	{
+		//a message bigger than the segment
+		if (seg.size + size > seg.capacity && !map_segment(seg, seg.size + size, true))
+			return;
+
+		//copied to the mapping, the commit only syncs it
+		std::uint8_t* out = seg.map + seg.size;
+		if (binary)
+			binary_segment::write_record(out, seg.nextOffset++, binary_segment::now(), message);
+		else
+		{
+			std::memcpy(out, message.data(), message.size());
+			out[message.size()] = '\n';
+		}
+		if (!seg.unsynced)
+		{
+			seg.unsynced = true;
+			m_Unsynced.push_back(&seg);
+		}
+	}
+	else
+	{
+		//the message is only buffered, it's written at the commit
+		if (seg.pending.empty())
+			m_Dirty.push_back(&seg);
+		if (binary)
+			binary_segment::append_record(seg.pending, seg.nextOffset++, binary_segment::now(), message);
+		else
+		{
+			seg.pending.append(message);
+			seg.pending.push_back('\n');
+		}
+	}
+	seg.size += size;
+	++m_UnsyncedMessages;
+
+	//the count mode syncs exactly every N messages, even inside a batch
+	if (m_Config.mode == durability::count && m_UnsyncedMessages >= m_Config.syncMessages)
+	{
+		for (segment* dirty : m_Dirty)
+			flush(*dirty);
+		m_Dirty.clear();
+		sync();
+	}
+}
+
+void Storage::close(const std::string& id)
+{
+	if (m_Log)
+	{
+		m_Log->forget(id);
+		return;
+	}
+
+	auto it = m_Segments.find(id);
+	if (it == m_Segments.end())
+		return;
+
+	if (it->second.detached)
+		m_Detached.erase(it->second.detachedAt);
+	close_segment(it->second);
+	m_Segments.erase(it);
+}
+
+void Storage::detach(const std::string& id)
+{
+	auto it = m_Segments.find(id);
+	if (it == m_Segments.end() || it->second.detached)
+		return;
+
+	//the pending messages are still written by the next commit
+	it->second.detached = true;
+	it->second.detachedAt = m_Detached.insert(m_Detached.end(), id);
+
+	//too many open segments, the oldest is closed
+	if (m_Detached.size() > m_Config.maxDetached)
+	{
+		std::string oldest = m_Detached.front();
+		close(oldest);
+	}
+}
+
+std::uint64_t Storage::commit()
+{
+	//one write per segment with all the messages of the batch
+	for (segment* seg : m_Dirty)
+		flush(*seg);
+	m_Dirty.clear();
+	if (m_Log)
+		m_Log->flush();
+
+	if (!m_Unsynced.empty() || (m_Log && m_Log->unsynced()))
+	{
+		switch (m_Config.mode)
+		{
+		case durability::batch:
+			sync();
+			break;
+		case durability::interval:
+			if (std::chrono::steady_clock::now() - m_LastSync >= m_Config.syncInterval)
+				sync();
+			break;
+		case durability::count:
+			if (m_UnsyncedMessages >= m_Config.syncMessages)
+				sync();
+			break;
+		case durability::none:
+			//nothing is synced, so we don't need to keep track of it
+			m_Unsynced.clear();
+			m_UnsyncedMessages = 0;
+			break;
+		}
+	}
+
+	//the writes and syncs of the batch go together
+	if (m_Ring)
+		m_Ring->submit();
+	return m_Sequence++;
+}
+
+std::uint64_t Storage::acknowledged() const
+{
+	if (!m_Ring)
+		return m_Sequence - 1;
+	return std::min(m_Sequence, m_Ring->oldest()) - 1;
+}
+
+void Storage::poll()
+{
+	if (m_Ring)
+		m_Ring->poll();
+}
+
+bool Storage::busy() const
+{
+	return m_Ring && m_Ring->busy();
+}
+
+void Storage::drain()
+{
+	if (m_Ring)
+		m_Ring->drain();
+}
+
+std::chrono::milliseconds Storage::time_to_sync() const
+{
+	if (m_Config.mode != durability::interval || (m_Unsynced.empty() && m_Dirty.empty() && !(m_Log && m_Log->unsynced())))
+		return std::chrono::milliseconds::max();
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_LastSync);
+	return std::max(std::chrono::milliseconds(0), m_Config.syncInterval - elapsed);
+}
+
+void Storage::rotate(const std::string& id, segment& seg)
+{
+	//the full segment is closed, it's pending messages are written
+	//and synced before, since it will not be in the unsynced list anymore
+	close_segment(seg);
+
+	//only done when a segment is created, not for every message
+	//if it fails the open below fails too and reports it
+	std::error_code error;
+	std::filesystem::create_directories(m_Config.outputDir + "/" + id, error);
+
+	std::filesystem::path path = new_segment_path(id);
+	seg.size = 0;
+	if (m_Config.preallocate)
+	{
+		//a spare is already allocated, without one it's allocated now
+		seg.fd = m_Allocator ? m_Allocator->take(path) : -1;
+		bool allocate = seg.fd < 0;
+		if (allocate)
+			seg.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (seg.fd >= 0 && !map_segment(seg, m_Config.fileSize, allocate))
+		{
+			::close(seg.fd);
+			seg.fd = -1;
+		}
+	}
+	else
+		seg.fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+	if (seg.fd < 0)
+	{
+		log_error() << "[STORAGE] Failed to open " << path << ": " << std::strerror(errno);
+		return;
+	}
+
+	//the header is written with the segment, before the ring takes it's fd
+	if (m_Config.format == segment_format::binary)
+	{
+		if (seg.map)
+			binary_segment::write_header(seg.map, seg.nextOffset);
+		else
+		{
+			std::string header;
+			binary_segment::append_header(header, seg.nextOffset);
+			if (!write_all(seg.fd, header.data(), header.size()))
+				log_error() << "[STORAGE] Failed to write: " << std::strerror(errno);
+		}
+		seg.size = sizeof(binary_segment::file_header);
+	}
+}
+
+void Storage::open(const std::string& id, segment& seg)
+{
+	namespace fs = std::filesystem;
+
+	//a new client doesn't have a directory yet
+	std::error_code error;
+	fs::path dir = m_Config.outputDir + "/" + id;
+	if (!fs::is_directory(dir, error))
+	{
+		rotate(id, seg);
+		return;
+	}
+
+	//the newest segment (by modification time) of the configured format
+	fs::path newest;
+	fs::file_time_type newestTime;
+	std::size_t newestSize = 0;
+	std::string prefix = m_Config.filePrefix + "_";
+	std::string_view extension = m_Config.format == segment_format::binary ? binary_segment::extension : ".txt";
+	for (const fs::directory_entry& entry : fs::directory_iterator(dir, error))
+	{
+		const fs::path& path = entry.path();
+		if (!entry.is_regular_file(error) || !path.filename().string().starts_with(prefix) || path.extension() != extension)
+			continue;
+
+		fs::file_time_type time = entry.last_write_time(error);
+		if (newest.empty() || time > newestTime)
+		{
+			newest = entry.path();
+			newestTime = time;
+			newestSize = entry.file_size(error);
+		}
+	}
+
+	//the offsets continue after the newest binary segment, even if it's full
+	//one that can't be appended to is taken as full
+	if (!newest.empty())
+		newestSize = resume(newest, seg) ? seg.size : m_Config.fileSize;
+
+	if (newest.empty() || newestSize >= m_Config.fileSize)
+	{
+		rotate(id, seg);
+		return;
+	}
+
+	int flags = m_Config.preallocate ? O_RDWR : O_WRONLY | O_APPEND;
+	seg.fd = ::open(newest.c_str(), flags | O_CLOEXEC);
+	seg.size = newestSize;
+	if (seg.fd >= 0 && m_Config.preallocate && !map_segment(seg, m_Config.fileSize, true))
+	{
+		::close(seg.fd);
+		seg.fd = -1;
+	}
+	if (seg.fd < 0)
+		rotate(id, seg);
+}
+
+bool Storage::resume(const std::filesystem::path& path, segment& seg)
+{
+	bool binary = m_Config.format == segment_format::binary;
+
+	int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	//a text segment written without preallocation ends at it's size
+	std::size_t size = st.st_size;
+	if (size == 0 || (!binary && !m_Config.preallocate))
+	{
+		::close(fd);
+		seg.size = size;
+		return !binary || size > 0;
+	}
+
+	void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+	{
+		::close(fd);
+		return false;
+	}
+	auto* bytes = static_cast<const std::uint8_t*>(data);
+
+	std::size_t end = size;
+	if (binary)
+	{
+		binary_segment::scan_result result = binary_segment::scan(bytes, size);
+		if (result.error == binary_segment::scan_error::header)
+		{
+			::munmap(data, size);
+			::close(fd);
+			return false;
+		}
+		if (result.error != binary_segment::scan_error::none)
+			log_warn() << "[STORAGE] " << path << ": " << binary_segment::to_string(result.error)
+				<< ", cut at " << result.valid << " of " << size << " bytes";
+		seg.nextOffset = result.nextOffset;
+		end = result.valid;
+	}
+	else
+	{
+		//the preallocated space is zeros
+		while (end > 0 && bytes[end - 1] == 0)
+			--end;
+	}
+	::munmap(data, size);
+
+	//what comes after the last valid record is lost
+	//the new records are appended after it
+	if (end < size && ::ftruncate(fd, end) != 0)
+	{
+		log_error() << "[STORAGE] Failed to truncate " << path << ": " << std::strerror(errno);
+		::close(fd);
+		return false;
+	}
+	::close(fd);
+
+	seg.size = end;
+	return true;
+}
+
+bool Storage::map_segment(segment& seg, std::size_t capacity, bool allocate)
+{
+	capacity = std::max(capacity, m_Config.fileSize);
+
+	//fallocate allocates the blocks without writing them, the file systems
+	//without it only get the size
+	if (allocate && ::fallocate(seg.fd, 0, 0, capacity) != 0 && ::ftruncate(seg.fd, capacity) != 0)
+	{
+		log_error() << "[STORAGE] Failed to allocate the segment: " << std::strerror(errno);
+		return false;
+	}
+
+	void* map = seg.map
+		? ::mremap(seg.map, seg.capacity, capacity, MREMAP_MAYMOVE)
+		: ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, seg.fd, 0);
+	if (map == MAP_FAILED)
+	{
+		log_error() << "[STORAGE] Failed to map the segment: " << std::strerror(errno);
+		return false;
+	}
+
+	seg.map = static_cast<std::uint8_t*>(map);
+	seg.capacity = capacity;
+	return true;
+}
+
+void Storage::flush(segment& seg)
+{
+	if (seg.pending.empty())
+		return;
+
+	//the ring takes the messages and records the write when it completes
+	if (m_Ring)
+		m_Ring->write(seg.file, seg.pending, m_Sequence);
+	else
+	{
+		auto begin = std::chrono::steady_clock::now();
+		if (!write_all(seg.fd, seg.pending.data(), seg.pending.size()))
+			log_error() << "[STORAGE] Failed to write: " << std::strerror(errno);
+		if (m_Metrics)
+			m_Metrics->write.record(elapsed_ns(begin));
+		seg.pending.clear();
+	}
+
+	if (!seg.unsynced)
+	{
+		seg.unsynced = true;
+		m_Unsynced.push_back(&seg);
+	}
+}
+
+void Storage::sync()
+{
+	if (m_Log)
+		m_Log->sync();
+
+	for (segment* seg : m_Unsynced)
+	{
+		//linked to the segment's write of the batch, if it has one
+		if (m_Ring)
+		{
+			m_Ring->sync(seg->file, m_Sequence);
+			seg->unsynced = false;
+			continue;
+		}
+
+		auto begin = std::chrono::steady_clock::now();
+		int result = seg->map ? ::msync(seg->map, seg->size, MS_SYNC) : ::fdatasync(seg->fd);
+		if (result != 0)
+			log_error() << "[STORAGE] Failed to sync: " << std::strerror(errno);
+		if (m_Metrics)
+			m_Metrics->sync.record(elapsed_ns(begin));
+		seg->unsynced = false;
+	}
+
+	m_Unsynced.clear();
+	m_UnsyncedMessages = 0;
+	m_LastSync = std::chrono::steady_clock::now();
+}
+
+void Storage::close_segment(segment& seg)
+{
+	if (seg.fd < 0)
+		return;
+
+	if (!seg.pending.empty())
+	{
+		flush(seg);
+		std::erase(m_Dirty, &seg);
+	}
+
+	//the ring closes it after it's last write
+	if (m_Ring)
+	{
+		m_Ring->close(seg.file, seg.unsynced && m_Config.mode != durability::none, m_Sequence);
+		if (seg.unsynced)
+			std::erase(m_Unsynced, &seg);
+		seg.unsynced = false;
+		seg.fd = -1;
+		seg.file = nullptr;
+		return;
+	}
+
+	//sealed: the space left is given back, the sync below
+	//writes the mapped pages and the new size
+	if (seg.map)
+	{
+		::munmap(seg.map, seg.capacity);
+		if (::ftruncate(seg.fd, seg.size) != 0)
+			log_error() << "[STORAGE] Failed to truncate the segment: " << std::strerror(errno);
+		seg.map = nullptr;
+		seg.capacity = 0;
+	}
+
+	if (seg.unsynced)
+	{
+		if (m_Config.mode != durability::none && ::fdatasync(seg.fd) != 0)
+			log_error() << "[STORAGE] Failed to sync: " << std::strerror(errno);
+		seg.unsynced = false;
+		std::erase(m_Unsynced, &seg);
+	}
+
+	::close(seg.fd);
+	seg.fd = -1;
+}
+
+std::filesystem::path Storage::new_segment_path(const std::string& id) const
+{
+	//current timestamp to string
+	auto now = std::chrono::system_clock::now();
+	auto tt = std::chrono::system_clock::to_time_t(now);
+	//localtime_r since the segments are created by several writers
+	std::tm tm;
+	auto localTime = localtime_r(&tt, &tm);
+
+	std::stringstream ss;
+	ss << localTime->tm_year + 1900 
+	<< localTime->tm_mon + 1 
+	<< localTime->tm_mday
+	<< localTime->tm_hour
+	<< localTime->tm_min
+	<< localTime->tm_sec;
+	std::string time = ss.str();
+
+	std::filesystem::path base = m_Config.outputDir + "/" + id + "/" + m_Config.filePrefix + "_" + time;
+
+	//more than one rotation in the same second
+	//so we add a counter to the name
+	std::filesystem::path path = base;
+	std::string extension(m_Config.format == segment_format::binary ? binary_segment::extension : ".txt");
+	path += extension;
+	for (int i = 1; std::filesystem::exists(path); ++i)
+	{
+		path = base;
+		path += "_" + std::to_string(i) + extension;
+	}
+
+	return path;
+}
@@ -0,0 +1,243 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+#include <list>
+#include "../common/metrics.h"
+#include "../common/logger.h"
+#include "UringWriter.h"
+#include "SegmentAllocator.h"
+#include "SharedLog.h"
+
+//how the written messages are made durable
+//none: the messages are written but never synced (the OS decides)
+//interval: the written segments are synced every interval
+//count: the written segments are synced every messages messages
+//batch: the written segments are synced at the end of every batch
+enum class durability
+{
+    none, interval, count, batch
+};
+
+//parses the durability mode name, throws if it's invalid
+durability durability_from_string(const std::string& mode);
+
+//how the segments are written
+//posix: blocking write and fdatasync by the writer thread
+//io_uring: queued to an io_uring, the writer only waits for the disk
+//when it has nothing else to do
+enum class storage_backend
+{
+    posix, io_uring
+};
+
+//parses the storage backend name, throws if it's invalid
+storage_backend storage_backend_from_string(const std::string& backend);
+
+//how the messages are stored in the segments
+//text: one message per line (.txt), a message with a new line breaks the framing
+//binary: length prefixed records with offset, timestamp and crc32c (.seg, see binary_segment.h)
+enum class segment_format
+{
+    text, binary
+};
+
+//parses the segment format name, throws if it's invalid
+segment_format segment_format_from_string(const std::string& format);
+
+//where the messages are stored
+//per_client: a directory per client with it's own segments
+//shared: the clients of each writer are appended to a shared log with
+//an index per client (see shared_log.h)
+enum class storage_layout
+{
+    per_client, shared
+};
+
+//parses the storage layout name, throws if it's invalid
+storage_layout storage_layout_from_string(const std::string& layout);
+
+struct storage_config
+{
+    std::string outputDir;
+    std::string filePrefix;
+    std::size_t fileSize = 0;
+
+    durability mode = durability::none;
+    std::chrono::milliseconds syncInterval{ 1000 };
+    std::size_t syncMessages = 1000;
+
+    //segments of disconnected clients (with an identity) kept open
+    //for their reconnection, the least recently detached are closed first
+    std::size_t maxDetached = 1024;
+
+    segment_format format = segment_format::text;
+
+    //the shared logs have their own format, they are always written
+    //with posix writes and without preallocation
+    storage_layout layout = storage_layout::per_client;
+    //index of the storage's writer, in the names of it's shared logs
+    std::size_t writer = 0;
+
+    //the segments are created with fileSize bytes allocated (fallocate) and
+    //written through a mapping, then cut to their length when they are closed
+    //the next segments are created in the background (spareSegments ready)
+    bool preallocate = false;
+    std::size_t spareSegments = 4;
+
+    storage_backend backend = storage_backend::posix;
+    //submission queue of the io_uring backend
+    unsigned uringEntries = 256;
+};
+
+//latency of the file operations, in nanoseconds
+struct storage_metrics
+{
+    metrics_histogram& write;
+    metrics_histogram& sync;
+};
+
+//persistence of the clients messages
+//each client has it's own directory with the files (segments) where it's messages
+//are appended, the active segment of each client is kept open with it's current
+//size so the hot path doesn't touch the filesystem metadata
+//when the segment is full it's closed and a new one is created (rotation)
+//the clients with an identity (handshake) keep the same directory across their
+//connections and their segment stays open while they are disconnected
+//-------
+//the messages are grouped (group commit): write only appends them to the segment's
+//pending buffer, and commit writes each segment with a single write and syncs
+//the written segments with a single fdatasync according to the durability mode
+//-------
+//with the io_uring backend commit only queues the writes (each linked to it's
+//sync), they complete later: the commits are numbered and acknowledged() tells
+//up to which one everything is written (and synced); a rotated or closed segment
+//is closed when it's last write completes
+//-------
+//with preallocation the messages are copied straight to the segment's mapping
+//(there is nothing to write at the commit, only to sync), and a rotation takes
+//a segment already created by the allocator
+//-------
+//with the shared layout the messages go to the writer's shared log instead,
+//the clients have no segment of their own
+class Storage {
+public:
+    //the allocator is shared by the storages, null creates the segments on rotation
+    Storage(const storage_config& config, const storage_metrics* metrics = nullptr,
+        SegmentAllocator* allocator = nullptr);
+    Storage(const Storage&) = delete;
+    ~Storage();
+
+    //appends the message to the client's active segment
+    void write(const std::string& id, std::string_view message);
+
+    //closes the client's active segment
+    void close(const std::string& id);
+
+    //the client disconnected but will reconnect with the same id
+    //the active segment is kept open so the reconnection appends to it
+    //without touching the filesystem
+    void detach(const std::string& id);
+
+    //writes the pending messages and syncs them if the durability mode requires it
+    //should be called at the end of every batch, returns the commit's sequence
+    std::uint64_t commit();
+
+    //the newest commit that is completely written (and synced)
+    //the posix backend completes the commits before returning them
+    std::uint64_t acknowledged() const;
+
+    //handles the completed writes of the io_uring backend, without waiting
+    void poll();
+
+    //writes are in flight, the writer should poll
+    bool busy() const;
+
+    //waits for all the writes in flight
+    void drain();
+
+    //time until the next sync is due, the writer should not sleep longer than it
+    //(only for the interval mode and if something was written)
+    std::chrono::milliseconds time_to_sync() const;
+
+private:
+    //active segment of a client
+    struct segment
+    {
+        int fd = -1;
+        //the fd is owned by the ring (io_uring backend)
+        UringWriter::file* file = nullptr;
+        std::size_t size = 0;
+        //offset of the client's next record (binary format)
+        std::uint64_t nextOffset = 0;
+        //mapping of the preallocated segment, size is the write position
+        std::uint8_t* map = nullptr;
+        std::size_t capacity = 0;
+        //messages not written yet
+        std::string pending;
+        //written but not synced
+        bool unsynced = false;
+        //the client is disconnected, position in m_Detached
+        bool detached = false;
+        std::list<std::string>::iterator detachedAt;
+    };
+
+    //closes the current segment (if open) and opens a new one
+    void rotate(const std::string& id, segment& seg);
+
+    //opens the segment of a client seen for the first time (by this Storage)
+    //the client's newest segment is reused if it isn't full, so a client with
+    //an identity keeps appending to it after a server restart
+    //it's the only time the client's directory is scanned
+    void open(const std::string& id, segment& seg);
+
+    //finds where the client's newest segment ends: for binary segments the offsets
+    //continue after it's last valid record and an incomplete record at the end is
+    //cut, the zeros left by the preallocation (crash before closing) are cut too
+    //returns false if the segment can't be appended to
+    bool resume(const std::filesystem::path& path, segment& seg);
+
+    //maps the segment (or grows it's mapping) with capacity bytes,
+    //allocating them first if allocate is set
+    bool map_segment(segment& seg, std::size_t capacity, bool allocate);
+
+    //writes the segment's pending messages
+    void flush(segment& seg);
+
+    //syncs all the written segments
+    void sync();
+
+    //flushes, syncs (if the durability mode requires it) and closes the segment
+    void close_segment(segment& seg);
+
+    //name of a new segment based on the current time
+    std::filesystem::path new_segment_path(const std::string& id) const;
+
+    const storage_config m_Config;
+    const storage_metrics* m_Metrics;
+    SegmentAllocator* m_Allocator;
+
+    //client id -> active segment
+    //unordered_map doesn't move it's elements so we can keep pointers to them
+    std::unordered_map<std::string, segment> m_Segments;
+    //ids of the detached segments, the least recent first
+    std::list<std::string> m_Detached;
+    //segments with pending messages
+    std::vector<segment*> m_Dirty;
+    //segments written and not synced
+    std::vector<segment*> m_Unsynced;
+    //io_uring backend, null for posix
+    std::unique_ptr<UringWriter> m_Ring;
+    //shared layout, null for per_client
+    std::unique_ptr<SharedLog> m_Log;
+    //sequence of the commit being built
+    std::uint64_t m_Sequence = 1;
+    //messages written since the last sync
+    std::size_t m_UnsyncedMessages = 0;
+    std::chrono::steady_clock::time_point m_LastSync = std::chrono::steady_clock::now();
+};
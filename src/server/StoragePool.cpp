@@ -0,0 +1,157 @@
+#include "../common/connection.h"
+#include "StoragePool.h"
+
+StoragePool::shard::shard(const storage_config& config, const storage_metrics* metrics, SegmentAllocator* allocator) :
+	storage(config, metrics, allocator)
+{
+}
+
+StoragePool::StoragePool(const storage_config& config, std::size_t writers, const storage_metrics* metrics,
+	const stage_metrics* stages) :
+	m_Stages(stages),
+	m_WholeBody(config.format == segment_format::binary || config.layout == storage_layout::shared)
+{
+	writers = std::max<std::size_t>(1, writers);
+	if (config.preallocate && config.layout == storage_layout::per_client)
+		m_Allocator = std::make_unique<SegmentAllocator>(config.outputDir, config.fileSize, config.spareSegments);
+
+	m_Shards.reserve(writers);
+	for (std::size_t i = 0; i < writers; ++i)
+	{
+		storage_config writerConfig = config;
+		writerConfig.writer = i;
+		m_Shards.emplace_back(std::make_unique<shard>(writerConfig, metrics, m_Allocator.get()));
+		shard& s = *m_Shards.back();
+		s.thread = std::thread([this, &s]() { writer(s); });
+	}
+}
+
+StoragePool::~StoragePool()
+{
+	//wakes the writers with a message without owner
+	//they write everything before it and leave
+	m_Stop = true;
+	for (auto& s : m_Shards)
+		s->queue.push_back({ nullptr, {}, {} });
+
+	for (auto& s : m_Shards)
+		if (s->thread.joinable()) s->thread.join();
+}
+
+void StoragePool::push(std::vector<msg_owner>& batch)
+{
+	for (msg_owner& msgIn : batch)
+	{
+		std::size_t i = msgIn.owner->storage_hash() % m_Shards.size();
+		m_Shards[i]->pending.push_back(std::move(msgIn));
+	}
+	batch.clear();
+
+	for (auto& s : m_Shards)
+	{
+		if (s->pending.empty()) continue;
+		s->queue.append(s->pending);
+		s->pending.clear();
+	}
+}
+
+std::size_t StoragePool::size() const
+{
+	return m_Shards.size();
+}
+
+void StoragePool::writer(shard& s)
+{
+	std::vector<msg_owner> batch;
+	batch.reserve(max_batch);
+
+	while (true)
+	{
+		//waits until the shard has at least one message
+		//or a sync is due (interval durability)
+		//or it's time to check the writes in flight
+		std::chrono::milliseconds timeout = s.storage.time_to_sync();
+		if (s.storage.busy() && timeout > std::chrono::milliseconds(0))
+			s.queue.wait_for(poll_interval);
+		else if (timeout == std::chrono::milliseconds::max())
+			s.queue.wait();
+		else
+			s.queue.wait_for(timeout);
+		acknowledge(s);
+
+		//takes the batch with a single lock, everything is written
+		//and synced (if needed) at the commit
+		batch.clear();
+		s.queue.drain_into(batch, max_batch);
+		for (msg_owner& msgIn : batch)
+		{
+			if (!msgIn.owner)
+			{
+				if (m_Stop)
+				{
+					s.storage.commit();
+					s.storage.drain();
+					acknowledge(s);
+					return;
+				}
+				continue;
+			}
+
+			const std::string& id = msgIn.owner->storage_id();
+
+			//the clients with an identity may reconnect
+			//so their segment is kept open
+			if (msgIn.message.empty() && msgIn.owner->has_identity())
+				s.storage.detach(id);
+			else if (msgIn.message.empty())
+				s.storage.close(id);
+			else
+				s.storage.write(id, m_WholeBody ? msgIn.message.bytes() : msgIn.message.view());
+		}
+
+		//the posix storage completes the commit before returning
+		std::uint64_t sequence = s.storage.commit();
+		if (s.unacknowledged.empty() && s.storage.acknowledged() >= sequence)
+			record_stages(batch);
+		else
+		{
+			s.unacknowledged.emplace_back(sequence, std::move(batch));
+			batch = {};
+			batch.reserve(max_batch);
+		}
+	}
+}
+
+void StoragePool::acknowledge(shard& s)
+{
+	s.storage.poll();
+
+	std::uint64_t acknowledged = s.storage.acknowledged();
+	while (!s.unacknowledged.empty() && s.unacknowledged.front().first <= acknowledged)
+	{
+		record_stages(s.unacknowledged.front().second);
+		s.unacknowledged.pop_front();
+	}
+}
+
+void StoragePool::record_stages(std::vector<msg_owner>& batch)
+{
+	if (!m_Stages)
+		return;
+
+	//the batch is complete after the commit
+	std::uint64_t now = msg_trace::now();
+	for (msg_owner& msgIn : batch)
+	{
+		//the closed connection markers aren't messages
+		if (!msgIn.owner || msgIn.message.empty())
+			continue;
+
+		msg_trace& trace = msgIn.trace;
+		trace.writeComplete = now;
+		m_Stages->receive.record(trace.bodyComplete - trace.headerRead);
+		m_Stages->queue.record(trace.dequeue - trace.queuePush);
+		m_Stages->storage.record(trace.writeComplete - trace.dequeue);
+		m_Stages->total.record(trace.writeComplete - trace.headerRead);
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include "../common/ts_queue.h"
+#include "../common/msg.h"
+#include "../common/metrics.h"
+#include "Storage.h"
+
+//latency of the stages of the messages (from their msg_trace)
+//recorded by the writers when the messages are written
+struct stage_metrics
+{
+    metrics_histogram& receive;
+    metrics_histogram& queue;
+    metrics_histogram& storage;
+    metrics_histogram& total;
+};
+
+//pool of storage writers, each one with it's own thread, queue and Storage
+//the clients are sharded by their storage id (identity or uuid), so all the
+//messages of a client (and of it's reconnections) are written by the same
+//writer in the order they were received, and a slow write
+//only delays the clients of that shard, never the message dispatch
+//each writer groups the messages waiting in it's queue in a single commit
+//with the io_uring storage the commits complete later, the writer keeps taking
+//batches meanwhile and polls the completions between them
+class StoragePool {
+public:
+    StoragePool(const storage_config& config, std::size_t writers, const storage_metrics* metrics = nullptr,
+        const stage_metrics* stages = nullptr);
+    StoragePool(const StoragePool&) = delete;
+    ~StoragePool();
+
+    //hands the messages over to the writers of their clients, the batch is
+    //split by shard and each shard receives it's part with a single lock
+    //an empty message closes the client's active segment
+    //the batch is left empty, should only be called by the dispatcher thread
+    void push(std::vector<msg_owner>& batch);
+
+    //number of writers
+    std::size_t size() const;
+
+private:
+    //writer of one shard
+    struct shard
+    {
+        shard(const storage_config& config, const storage_metrics* metrics, SegmentAllocator* allocator);
+
+        ts_queue<msg_owner> queue;
+        Storage storage;
+        std::thread thread;
+
+        //part of the dispatcher batch that goes to this shard
+        std::vector<msg_owner> pending;
+
+        //committed batches waiting for their writes, the oldest first
+        std::deque<std::pair<std::uint64_t, std::vector<msg_owner>>> unacknowledged;
+    };
+
+    //writer thread loop
+    //the messages are handled in batches (up to max_batch) and committed together
+    void writer(shard& s);
+
+    //records the stages of the written messages
+    void record_stages(std::vector<msg_owner>& batch);
+
+    //handles the completed writes, the batches acknowledged
+    //by the storage are done
+    void acknowledge(shard& s);
+
+    static constexpr std::size_t max_batch = 4096;
+    //how long a writer with writes in flight waits for new messages
+    //before checking their completions
+    static constexpr std::chrono::microseconds poll_interval{ 200 };
+
+    const stage_metrics* m_Stages;
+    //the length prefixed records (binary segments, shared logs) store the whole
+    //body, the text segments only up to it's null terminator
+    const bool m_WholeBody;
+
+    //preallocated segments shared by the writers, null without preallocation
+    //destroyed after the writers, that may still take from it
+    std::unique_ptr<SegmentAllocator> m_Allocator;
+
+    std::vector<std::unique_ptr<shard>> m_Shards;
+    std::atomic<bool> m_Stop = false;
+};
@@ -0,0 +1,276 @@
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <unistd.h>
+#include "../common/logger.h"
+#include "UringWriter.h"
+#include "Storage.h"
+
+//nanoseconds since begin
+static std::uint64_t elapsed_ns(std::chrono::steady_clock::time_point begin)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+}
+
+UringWriter::file::file(UringWriter& owner, int fd) :
+	owner(owner),
+	fd(fd)
+{
+}
+
+void UringWriter::file::on_uring(std::uint8_t op, int result, std::uint32_t /*flags*/)
+{
+	owner.completed(*this, op, result);
+}
+
+void UringWriter::file::on_uring_abandon()
+{
+	//the writer drains the ring before destroying it
+}
+
+UringWriter::UringWriter(unsigned entries, const storage_metrics* metrics) :
+	m_Ring(uring::options{ entries, 0 }),
+	m_Metrics(metrics)
+{
+}
+
+UringWriter::~UringWriter()
+{
+	drain();
+	//closed without waiting for them, only if they weren't closed by the storage
+	for (auto& [ptr, f] : m_Files)
+		::close(f->fd);
+}
+
+UringWriter::file* UringWriter::open(int fd)
+{
+	auto f = std::make_unique<file>(*this, fd);
+	file* ptr = f.get();
+	m_Files.emplace(ptr, std::move(f));
+	return ptr;
+}
+
+void UringWriter::write(file* f, std::string& data, std::uint64_t sequence)
+{
+	if (data.empty())
+		return;
+
+	if (f->nextSequence == 0)
+	{
+		f->nextSequence = sequence;
+		hold(sequence);
+	}
+
+	//the common case is a single write per batch, the buffers
+	//are just exchanged
+	if (f->next.empty())
+		f->next.swap(data);
+	else
+		f->next.append(data);
+	data.clear();
+
+	if (!f->ready && f->inFlight == 0)
+	{
+		f->ready = true;
+		m_Ready.push_back(f);
+	}
+}
+
+void UringWriter::sync(file* f, std::uint64_t sequence)
+{
+	if (f->nextSequence == 0)
+	{
+		f->nextSequence = sequence;
+		hold(sequence);
+	}
+	f->nextSync = true;
+
+	if (!f->ready && f->inFlight == 0)
+	{
+		f->ready = true;
+		m_Ready.push_back(f);
+	}
+}
+
+void UringWriter::close(file* f, bool sync, std::uint64_t sequence)
+{
+	if (sync)
+		this->sync(f, sequence);
+	f->closing = true;
+
+	if (f->inFlight == 0 && f->nextSequence == 0)
+		finish(*f);
+}
+
+void UringWriter::submit()
+{
+	//the completions handled while starting may add more files
+	std::vector<file*> ready;
+	ready.swap(m_Ready);
+	for (file* f : ready)
+	{
+		f->ready = false;
+		if (f->inFlight == 0)
+			start(*f);
+	}
+	m_Ring.submit();
+}
+
+void UringWriter::poll()
+{
+	if (m_Ring.pending() > 0)
+		m_Ring.reap();
+	//the files that completed may have more to write
+	if (!m_Ready.empty())
+		submit();
+}
+
+void UringWriter::drain()
+{
+	submit();
+	while (m_Ring.pending() > 0 || !m_Ready.empty())
+	{
+		m_Ring.submit_and_wait(1);
+		m_Ring.reap();
+		submit();
+	}
+}
+
+bool UringWriter::busy() const
+{
+	return !m_Outstanding.empty();
+}
+
+std::uint64_t UringWriter::oldest() const
+{
+	if (m_Outstanding.empty())
+		return std::numeric_limits<std::uint64_t>::max();
+	return m_Outstanding.begin()->first;
+}
+
+void UringWriter::start(file& f)
+{
+	//a short write is continued with the rest of the same data
+	if (f.written == f.writing.size())
+	{
+		if (f.nextSequence == 0)
+			return;
+
+		f.writing.swap(f.next);
+		f.next.clear();
+		f.written = 0;
+		f.writingSync = f.nextSync;
+		f.writingSequence = f.nextSequence;
+		f.nextSync = false;
+		f.nextSequence = 0;
+	}
+
+	//counted in flight before anything that can handle completions, and both
+	//entries are reserved before preparing them, so the write and it's linked
+	//sync always go in the same submission (a split chain would let the sync
+	//complete before the write)
+	bool write = f.written < f.writing.size();
+	f.inFlight += write + f.writingSync;
+	m_Ring.reserve(write + f.writingSync);
+
+	f.issued = std::chrono::steady_clock::now();
+	if (write)
+	{
+		io_uring_sqe* sqe = m_Ring.prepare(&f, op_write);
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = f.fd;
+		sqe->addr = reinterpret_cast<std::uint64_t>(f.writing.data() + f.written);
+		sqe->len = static_cast<std::uint32_t>(f.writing.size() - f.written);
+		//the file position, it's opened with O_APPEND
+		sqe->off = static_cast<std::uint64_t>(-1);
+		//the sync only starts after the write succeeded completely
+		if (f.writingSync)
+			sqe->flags = IOSQE_IO_LINK;
+	}
+
+	if (f.writingSync)
+	{
+		io_uring_sqe* sqe = m_Ring.prepare(&f, op_sync);
+		sqe->opcode = IORING_OP_FSYNC;
+		sqe->fd = f.fd;
+		sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	}
+}
+
+void UringWriter::completed(file& f, std::uint8_t op, int result)
+{
+	--f.inFlight;
+
+	if (op == op_write)
+	{
+		if (m_Metrics)
+			m_Metrics->write.record(elapsed_ns(f.issued));
+
+		if (result < 0)
+		{
+			//the data is lost, like a failed write of the posix backend
+			log_error() << "[STORAGE] Failed to write: " << std::strerror(-result);
+			f.written = f.writing.size();
+		}
+		else
+			f.written += result;
+		f.issued = std::chrono::steady_clock::now();
+	}
+	else if (result == -ECANCELED)
+	{
+		//the write was short or failed so the linked sync was cancelled
+		//after a short write both are issued again with the rest
+		if (f.written == f.writing.size())
+			f.writingSync = false;
+	}
+	else
+	{
+		if (result < 0)
+			log_error() << "[STORAGE] Failed to sync: " << std::strerror(-result);
+		else if (m_Metrics)
+			m_Metrics->sync.record(elapsed_ns(f.issued));
+		f.writingSync = false;
+	}
+
+	if (f.inFlight > 0)
+		return;
+
+	//the rest of a short write or what was queued meanwhile
+	bool shortWrite = f.written < f.writing.size();
+	if (!shortWrite)
+	{
+		release(f.writingSequence);
+		f.writingSequence = 0;
+	}
+
+	if (shortWrite || f.nextSequence != 0)
+	{
+		if (!f.ready)
+		{
+			f.ready = true;
+			m_Ready.push_back(&f);
+		}
+		return;
+	}
+
+	if (f.closing)
+		finish(f);
+}
+
+void UringWriter::finish(file& f)
+{
+	::close(f.fd);
+	m_Files.erase(&f);
+}
+
+void UringWriter::hold(std::uint64_t sequence)
+{
+	++m_Outstanding[sequence];
+}
+
+void UringWriter::release(std::uint64_t sequence)
+{
+	auto it = m_Outstanding.find(sequence);
+	if (it != m_Outstanding.end() && --it->second == 0)
+		m_Outstanding.erase(it);
+}
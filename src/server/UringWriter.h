@@ -0,0 +1,113 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <chrono>
+#include "../common/uring.h"
+
+struct storage_metrics;
+
+//appends to the segment files through an io_uring owned by a storage writer
+//the writes (and the fdatasync linked to them) are queued and submitted together,
+//the writer doesn't wait for the disk: it polls the completions between batches
+//-------
+//each file has at most one write (+ sync) in flight, what is queued while it's
+//in flight goes in the next one, so the writes land in order and a sync covers
+//everything written before it; a closed file is only closed when it's last
+//write completes
+//-------
+//the queued data is tagged with the commit sequence it belongs to, a commit
+//is acknowledged when all the data of it (and of the older ones) is written
+class UringWriter {
+public:
+    struct file;
+
+    //throws std::system_error if the ring can't be created
+    UringWriter(unsigned entries, const storage_metrics* metrics = nullptr);
+    UringWriter(const UringWriter&) = delete;
+    //waits for everything queued, the files are closed
+    ~UringWriter();
+
+    //the file (opened with O_APPEND) is owned by the writer until it's closed
+    file* open(int fd);
+
+    //appends the data to the file, data is left empty (it's storage is swapped
+    //with an old buffer when possible)
+    void write(file* f, std::string& data, std::uint64_t sequence);
+
+    //syncs what was written to the file before
+    void sync(file* f, std::uint64_t sequence);
+
+    //closes the file after it's queued data (and sync if requested)
+    void close(file* f, bool sync, std::uint64_t sequence);
+
+    //submits what was queued
+    void submit();
+
+    //handles the completions available, without waiting
+    void poll();
+
+    //waits until nothing is in flight
+    void drain();
+
+    //something is queued or in flight
+    bool busy() const;
+
+    //oldest sequence not written (or synced) yet, max if none
+    std::uint64_t oldest() const;
+
+private:
+    enum : std::uint8_t { op_write, op_sync };
+
+    //issues the next write of an idle file
+    void start(file& f);
+
+    //a write or sync of the file completed
+    void completed(file& f, std::uint8_t op, int result);
+
+    //the file is idle and closing, it's fd is closed and it's removed
+    void finish(file& f);
+
+    //tracks a sequence until it's data is done
+    void hold(std::uint64_t sequence);
+    void release(std::uint64_t sequence);
+
+    uring m_Ring;
+    const storage_metrics* m_Metrics;
+
+    std::unordered_map<file*, std::unique_ptr<file>> m_Files;
+    //idle files with something queued, started by submit
+    std::vector<file*> m_Ready;
+    //sequence -> number of queued or in flight writes with data of it
+    std::map<std::uint64_t, std::size_t> m_Outstanding;
+};
+
+struct UringWriter::file : public uring_handler
+{
+    file(UringWriter& owner, int fd);
+
+    void on_uring(std::uint8_t op, int result, std::uint32_t flags) override;
+    void on_uring_abandon() override;
+
+    UringWriter& owner;
+    int fd;
+
+    //in flight
+    std::string writing;
+    std::size_t written = 0;
+    bool writingSync = false;
+    std::uint64_t writingSequence = 0;
+    unsigned inFlight = 0;
+    std::chrono::steady_clock::time_point issued;
+
+    //queued for the next write, sequence 0 if nothing is queued
+    std::string next;
+    bool nextSync = false;
+    std::uint64_t nextSequence = 0;
+
+    bool ready = false;
+    bool closing = false;
+};
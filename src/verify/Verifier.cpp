@@ -0,0 +1,187 @@
+#include <thread>
+#include <chrono>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../common/crc32c.h"
+#include "Verifier.h"
+
+Verifier::Verifier(const verify_config& config) :
+	m_Config(config)
+{
+	if (m_Config.threads == 0)
+		m_Config.threads = std::max(1u, std::thread::hardware_concurrency());
+	if (m_Config.print)
+		m_Config.threads = 1;
+}
+
+bool Verifier::run()
+{
+	for (const std::string& path : m_Config.paths)
+		collect(path);
+
+	//the segments of a client in order, it's the order they are printed
+	std::sort(m_Reports.begin(), m_Reports.end(),
+		[](const segment_report& a, const segment_report& b) { return a.path < b.path; });
+
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < std::min(m_Config.threads, m_Reports.size()); ++i)
+		threads.emplace_back([this]() { worker(); });
+	for (std::thread& t : threads)
+		t.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	std::size_t invalid = 0;
+	std::uint64_t records = 0;
+	std::uint64_t bytes = 0;
+	for (const segment_report& report : m_Reports)
+	{
+		records += report.result.records;
+		bytes += report.size;
+		if (!report.failure.empty())
+		{
+			std::cerr << report.path.string() << ": " << report.failure << "\n";
+			++invalid;
+		}
+		else if (report.result.error != binary_segment::scan_error::none)
+		{
+			std::cerr << report.path.string() << ": " << binary_segment::to_string(report.result.error)
+				<< " at byte " << report.result.valid << " of " << report.size
+				<< " (offset " << report.result.nextOffset << ")\n";
+			++invalid;
+		}
+	}
+	invalid += check_continuity();
+
+	std::cerr << "[VERIFY] " << m_Reports.size() << " segments, " << records << " records, "
+		<< bytes / (1024.0 * 1024.0) << " MB in " << seconds * 1000 << " ms ("
+		<< (seconds > 0 ? bytes / seconds / (1024.0 * 1024.0 * 1024.0) : 0) << " GB/s, "
+		<< m_Config.threads << " threads, crc32c " << (crc32c_hardware() ? "sse4.2" : "software") << ")\n";
+	if (invalid > 0)
+		std::cerr << "[VERIFY] " << invalid << " problems found\n";
+	return invalid == 0;
+}
+
+void Verifier::collect(const std::filesystem::path& path)
+{
+	namespace fs = std::filesystem;
+
+	std::error_code error;
+	if (fs::is_regular_file(path, error))
+	{
+		m_Reports.emplace_back(path);
+		return;
+	}
+
+	if (!fs::is_directory(path, error))
+	{
+		std::cerr << "[VERIFY] " << path.string() << " not found\n";
+		return;
+	}
+
+	for (const fs::directory_entry& entry : fs::recursive_directory_iterator(path, error))
+		if (entry.is_regular_file(error) && entry.path().extension() == binary_segment::extension)
+			m_Reports.emplace_back(entry.path());
+}
+
+void Verifier::worker()
+{
+	while (true)
+	{
+		std::size_t i = m_Next.fetch_add(1, std::memory_order_relaxed);
+		if (i >= m_Reports.size())
+			return;
+		scan(m_Reports[i]);
+	}
+}
+
+void Verifier::scan(segment_report& report)
+{
+	int fd = ::open(report.path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		report.failure = std::strerror(errno);
+		return;
+	}
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0)
+	{
+		report.failure = std::strerror(errno);
+		::close(fd);
+		return;
+	}
+	report.size = st.st_size;
+
+	//an empty file is reported as not being a segment
+	void* data = nullptr;
+	if (report.size > 0)
+	{
+		data = ::mmap(nullptr, report.size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			report.failure = std::strerror(errno);
+			::close(fd);
+			return;
+		}
+		::madvise(data, report.size, MADV_SEQUENTIAL);
+	}
+	::close(fd);
+
+	auto* bytes = static_cast<const std::uint8_t*>(data);
+	if (m_Config.print)
+	{
+		std::cout << "# " << report.path.string() << "\n";
+		report.result = binary_segment::scan(bytes, report.size,
+			[](const binary_segment::record_header& header, std::string_view message)
+			{
+				std::cout << header.offset << ' ' << header.timestamp << ' ' << message << "\n";
+			});
+	}
+	else
+		report.result = binary_segment::scan(bytes, report.size);
+
+	if (data)
+		::munmap(data, report.size);
+}
+
+std::size_t Verifier::check_continuity() const
+{
+	//directory -> segments by base offset
+	std::map<std::filesystem::path, std::vector<const segment_report*>> clients;
+	for (const segment_report& report : m_Reports)
+		if (report.failure.empty() && report.result.error != binary_segment::scan_error::header)
+			clients[report.path.parent_path()].push_back(&report);
+
+	std::size_t problems = 0;
+	for (auto& [dir, segments] : clients)
+	{
+		//a segment without records has the base offset of the next one, it goes first
+		std::sort(segments.begin(), segments.end(),
+			[](const segment_report* a, const segment_report* b)
+			{
+				return std::tie(a->result.baseOffset, a->result.nextOffset, a->path)
+					< std::tie(b->result.baseOffset, b->result.nextOffset, b->path);
+			});
+
+		for (std::size_t i = 1; i < segments.size(); ++i)
+		{
+			const segment_report& previous = *segments[i - 1];
+			const segment_report& current = *segments[i];
+			if (previous.result.nextOffset == current.result.baseOffset)
+				continue;
+
+			std::cerr << current.path.string() << ": starts at offset " << current.result.baseOffset
+				<< " but " << previous.path.filename().string() << " ends at " << previous.result.nextOffset << "\n";
+			++problems;
+		}
+	}
+	return problems;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <filesystem>
+#include "../common/binary_segment.h"
+
+struct verify_config
+{
+    //segment files or directories (searched recursively)
+    std::vector<std::string> paths;
+    //0 uses one thread per hardware thread
+    std::size_t threads = 0;
+    //prints the records, the segments are read by a single thread
+    bool print = false;
+};
+
+//reader and verifier of the binary segments
+//the segments are mapped and scanned in parallel (one segment per thread at
+//a time), every record's checksum and offset is checked, then the segments of
+//each client (directory) are checked to continue each other's offsets
+class Verifier {
+public:
+    explicit Verifier(const verify_config& config);
+
+    //scans everything and reports, returns false if any segment is invalid
+    bool run();
+
+private:
+    struct segment_report
+    {
+        explicit segment_report(const std::filesystem::path& path) : path(path) {}
+
+        std::filesystem::path path;
+        std::size_t size = 0;
+        binary_segment::scan_result result;
+        //the file couldn't be read
+        std::string failure;
+    };
+
+    //gathers the segment files of a path
+    void collect(const std::filesystem::path& path);
+
+    //scanning thread, takes the next segment until there are none
+    void worker();
+
+    void scan(segment_report& report);
+
+    //the segments of a directory, ordered by their base and next offsets, must not
+    //leave gaps between them, returns the number of problems
+    std::size_t check_continuity() const;
+
+    verify_config m_Config;
+    std::vector<segment_report> m_Reports;
+    std::atomic<std::size_t> m_Next = 0;
+};
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <string>
+#include "Verifier.h"
+
+static void usage()
+{
+	std::cout << "Usage: segment_verify [options] PATH...\n"
+		<< "  PATH                  binary segment (.seg) or directory searched recursively\n"
+		<< "  --threads N           scanning threads, 0 uses one per hardware thread (0)\n"
+		<< "  --print               prints the records (offset, timestamp in ns, message)\n";
+}
+
+int main(int argc, char* argv[])
+{
+	verify_config config;
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string option = argv[i];
+			if (option == "--help")
+			{
+				usage();
+				return 0;
+			}
+			if (option == "--print")
+			{
+				config.print = true;
+				continue;
+			}
+			if (!option.starts_with("--"))
+			{
+				config.paths.push_back(option);
+				continue;
+			}
+			if (i + 1 >= argc)
+				throw std::invalid_argument("missing value of " + option);
+
+			std::string value = argv[++i];
+			if (option == "--threads") config.threads = std::stoull(value);
+			else throw std::invalid_argument("unknown option " + option);
+		}
+		if (config.paths.empty())
+			throw std::invalid_argument("no path");
+
+		Verifier verifier(config);
+		return verifier.run() ? 0 : 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "[VERIFY] " << e.what() << "\n";
+		usage();
+		return 1;
+	}
+}